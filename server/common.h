@@ -35,6 +35,18 @@ struct np2_sessions {
 
     int flags;              /* various flags */
 #define NP2S_CAND_CHANGED 0x01
+#define NP2S_CAND_ALL     0x02  /* changes of candidate are not known per module */
+    char **cand_mods;       /* names of the modules changed in candidate (without NP2S_CAND_ALL) */
+    uint16_t cand_mod_count;
+
+    struct np2_paging {     /* iteration of a paged read kept for its next page */
+        char *cursor;       /* next-cursor of the page the iteration stopped after */
+        char *xpath;        /* iterated list instances */
+        sr_datastore_t ds;
+        sr_sess_options_t opts;
+        sr_val_iter_t *iter;
+        sr_val_t *next;     /* first instance of the next page, already read */
+    } paging;
 };
 
 /* Netopeer server internal data */
@@ -57,6 +69,7 @@ int np2srv_sr_reconnect(void);
 
 int ietf_netconf_server_init(const struct lys_module *module);
 int ietf_system_init(const struct lys_module *module);
+int netopeer2_server_init(const struct lys_module *module);
 
 void np2srv_new_session_clb(const char *UNUSED(client_name), struct nc_session *new_session);
 
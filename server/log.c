@@ -30,6 +30,11 @@
  */
 volatile uint8_t np2_verbose_level;
 
+/**
+ * @brief netopeer2 debug message categories
+ */
+volatile uint32_t np2_dbg_categories;
+
 /**
  * @brief libssh verbose level variable
  */
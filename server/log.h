@@ -34,6 +34,13 @@ extern volatile uint8_t np2_libssh_verbose_level;
  */
 extern volatile uint8_t np2_sr_verbose_level;
 
+/**
+ * @brief Enabled debug message categories (NP2_DBG_*), only in debug build type
+ */
+extern volatile uint32_t np2_dbg_categories;
+
+#define NP2_DBG_EDIT_CONFIG 0x01    /**< edit-config operation processing */
+
 /**
  * @brief internal printing function, follows the levels from libnetconf2
  * @param[in] level Verbose level
@@ -47,7 +54,19 @@ void np2log_printf(NC_VERB_LEVEL level, const char *format, ...);
 #define ERR(format,args...) np2log_printf(NC_VERB_ERROR,format,##args)
 #define WRN(format,args...) if(np2_verbose_level>=NC_VERB_WARNING){np2log_printf(NC_VERB_WARNING,format,##args);}
 #define VRB(format,args...) if(np2_verbose_level>=NC_VERB_VERBOSE){np2log_printf(NC_VERB_VERBOSE,format,##args);}
+
+/*
+ * Debug messages, DBG_ON() can be used to skip preparing their expensive arguments,
+ * in release build type they are compiled out completely
+ */
+#ifndef NDEBUG
+#define DBG_ON(cat) ((np2_verbose_level>=NC_VERB_DEBUG)&&(np2_dbg_categories&(cat)))
 #define DBG(format,args...) if(np2_verbose_level>=NC_VERB_DEBUG){np2log_printf(NC_VERB_DEBUG,format,##args);}
+#else
+#define DBG_ON(cat) 0
+#define DBG(format,args...) if(0){np2log_printf(NC_VERB_DEBUG,format,##args);}
+#endif
+#define DBG_CAT(cat,format,args...) if(DBG_ON(cat)){np2log_printf(NC_VERB_DEBUG,format,##args);}
 
 #define EMEM ERR("Memory allocation failed (%s:%d)", __FILE__, __LINE__)
 #define EINT ERR("Internal error (%s:%d)", __FILE__, __LINE__)
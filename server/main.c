@@ -77,6 +77,8 @@ np2srv_sr_reconnect(void)
 
     if (!np2srv.disconnected) {
         sr_unsubscribe(np2srv.sr_sess.srs, np2srv.sr_subscr);
+        op_config_cache_reset();
+        op_startup_reset();
         /* connection and all the sessions get freed */
         sr_disconnect(np2srv.sr_conn);
 
@@ -111,6 +113,8 @@ np2srv_sr_reconnect(void)
     /* client sessions, client subscriptions are stored in persistent files, no need to make them again */
     for (i = 0; (nc_sess = nc_ps_get_session(np2srv.nc_ps, i)); ++i) {
         np2_sess = (struct np2_sessions *)nc_session_get_data(nc_sess);
+        /* the iteration belonged to the previous session */
+        op_get_paging_clear(np2_sess);
         rc = sr_session_start_user(np2srv.sr_conn, nc_session_get_username(nc_sess), np2_sess->ds, np2_sess->opts, &np2_sess->srs);
         if (rc != SR_ERR_OK) {
             goto finish;
@@ -302,10 +306,15 @@ free_ds(void *ptr)
 
     if (ptr) {
         s = (struct np2_sessions *)ptr;
+        op_get_paging_clear(s);
         if (s->srs) {
             sr_session_stop(s->srs);
         }
+        if (s->ncs) {
+            op_confirmed_session_end(s->ncs);
+        }
         np2srv_clean_dslock(s->ncs);
+        op_cand_clear(s);
         free(s);
     }
 }
@@ -433,6 +442,19 @@ np2srv_create_capab(const struct lys_module *mod)
     return cpb;
 }
 
+/* the libyang context was modified, everything compiled against it is invalid, called with the context write-locked */
+static void
+np2srv_ly_ctx_changed(void)
+{
+    op_filter_cache_clear();
+    op_dec64_cache_clear();
+    op_validate_cache_clear();
+    op_config_cache_clear();
+    op_state_cache_clear();
+    op_mod_index_rebuild();
+    op_params_resolve();
+}
+
 static void
 np2srv_module_install_clb(const char *module_name, const char *revision, sr_module_state_t state, void *UNUSED(private_ctx))
 {
@@ -485,6 +507,7 @@ np2srv_module_install_clb(const char *module_name, const char *revision, sr_modu
 
             /* set RPC, action and notification callbacks */
             np2srv_module_assign_clbs(mod);
+            np2srv_ly_ctx_changed();
 
             cpb = np2srv_create_capab(mod);
             np2srv_send_capab_change_notif(cpb, NULL, NULL);
@@ -503,6 +526,7 @@ np2srv_module_install_clb(const char *module_name, const char *revision, sr_modu
         /* the function can fail in case the module was already removed
          * because of dependency in some of the previous calls */
         if (!ly_ctx_remove_module(mod, NULL)) {
+            np2srv_ly_ctx_changed();
             np2srv_send_capab_change_notif(NULL, cpb, NULL);
         } else {
             ERR("Removing module \"%s%s%s\" failed.", module_name, revision ? "@" : "", revision ? revision : "");
@@ -543,6 +567,7 @@ np2srv_feature_change_clb(const char *module_name, const char *feature_name, boo
     } else {
         lys_features_disable(mod, feature_name);
     }
+    np2srv_ly_ctx_changed();
     cpb = np2srv_create_capab(mod);
     pthread_rwlock_unlock(&np2srv.ly_ctx_lock);
 
@@ -850,7 +875,7 @@ np2srv_init_schemas(void)
     }
     lys_features_enable(mod, "writable-running");
     lys_features_enable(mod, "candidate");
-    /* TODO lys_features_enable(mod, "confirmed-commit"); */
+    lys_features_enable(mod, "confirmed-commit");
     lys_features_enable(mod, "rollback-on-error");
     lys_features_enable(mod, "validate");
     lys_features_enable(mod, "startup");
@@ -941,6 +966,10 @@ server_init(void)
     if (np2srv_init_schemas()) {
         goto error;
     }
+    if (op_mod_index_rebuild()) {
+        goto error;
+    }
+    op_params_resolve();
 
     /* init monitoring */
     ncm_init();
@@ -996,10 +1025,8 @@ server_init(void)
     snode = ly_ctx_get_node(np2srv.ly_ctx, NULL, "/ietf-netconf:kill-session", 0);
     nc_set_rpc_callback(snode, op_kill);
 
-    /* TODO
     snode = ly_ctx_get_node(np2srv.ly_ctx, NULL, "/ietf-netconf:cancel-commit", 0);
-    nc_set_rpc_callback(snode, op_cancel);
-     */
+    nc_set_rpc_callback(snode, op_cancelcommit);
 
     /* set Notifications subscription callback */
     snode = ly_ctx_get_node(np2srv.ly_ctx, NULL, "/notifications:create-subscription", 0);
@@ -1040,6 +1067,12 @@ server_init(void)
         }
     }
 
+    /* server extensions */
+    mod = ly_ctx_get_module(np2srv.ly_ctx, "netopeer2-server", NULL, 1);
+    if (mod && netopeer2_server_init(mod)) {
+        goto error;
+    }
+
     return 0;
 
 error:
@@ -1235,6 +1268,7 @@ main(int argc, char *argv[])
                 } else if (!strcmp(ptr, "EDIT_CONFIG")) {
                     /* edit-config operations - only netopeer2 debug verbosity */
                     np2_verbose_level = NC_VERB_DEBUG;
+                    np2_dbg_categories |= NP2_DBG_EDIT_CONFIG;
                 } else if (!strcmp(ptr, "SSH")) {
                     /* 2 should be always enough, 3 is too much useless info */
                     np2_libssh_verbose_level = 2;
@@ -1356,6 +1390,9 @@ restart:
     } while (i < NP2SRV_THREAD_COUNT);
 
 cleanup:
+    /* running must not stay with an unconfirmed commit */
+    op_confirmed_stop();
+
     /* disconnect from sysrepo */
     if (np2srv.sr_subscr) {
         sr_unsubscribe(np2srv.sr_sess.srs, np2srv.sr_subscr);
@@ -1376,6 +1413,14 @@ cleanup:
     ncm_destroy();
 
     /* libyang cleanup */
+    op_filter_cache_clear();
+    op_dec64_cache_clear();
+    op_validate_cache_clear();
+    op_config_cache_reset();
+    op_startup_reset();
+    op_copyconfig_incremental_configure(0);
+    op_state_cache_configure(NULL, NULL, 0);
+    op_mod_index_clear();
     ly_ctx_destroy(np2srv.ly_ctx, NULL);
 
     /* are we requested to stop or just to restart? */
@@ -13,6 +13,7 @@
  */
 #include <time.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
@@ -186,6 +187,81 @@ ncm_bad_hello(void)
     pthread_mutex_unlock(&stats.lock);
 }
 
+static int
+ncm_get_server_data(struct lyd_node *root)
+{
+    struct lyd_node *np2, *cont, *list;
+    struct op_state_cache_stat *stats;
+    uint32_t count, i;
+    uint64_t hits, misses, used, peak[OP_MEM_TYPE_COUNT];
+    char buf[21];
+
+    np2 = lyd_new_path(root, NULL, "/ietf-netconf-monitoring:netconf-state/netopeer2-server:netopeer2-server", NULL, 0, 0);
+    if (!np2) {
+        return -1;
+    }
+
+    /* filter cache */
+    op_filter_cache_stats(&count, &hits, &misses);
+    cont = lyd_new(np2, NULL, "filter-cache");
+    sprintf(buf, "%u", count);
+    lyd_new_leaf(cont, NULL, "entries", buf);
+    sprintf(buf, "%" PRIu64, hits);
+    lyd_new_leaf(cont, NULL, "hits", buf);
+    sprintf(buf, "%" PRIu64, misses);
+    lyd_new_leaf(cont, NULL, "misses", buf);
+
+    /* validate cache */
+    op_validate_cache_stats(&count, &hits, &misses);
+    cont = lyd_new(np2, NULL, "validate-cache");
+    sprintf(buf, "%u", count);
+    lyd_new_leaf(cont, NULL, "entries", buf);
+    sprintf(buf, "%" PRIu64, hits);
+    lyd_new_leaf(cont, NULL, "hits", buf);
+    sprintf(buf, "%" PRIu64, misses);
+    lyd_new_leaf(cont, NULL, "misses", buf);
+
+    /* reply memory */
+    op_mem_stats(&used, peak);
+    cont = lyd_new(np2, NULL, "memory");
+    sprintf(buf, "%" PRIu64, used);
+    lyd_new_leaf(cont, NULL, "used", buf);
+    sprintf(buf, "%" PRIu64, peak[OP_MEM_GET]);
+    lyd_new_leaf(cont, NULL, "get-peak", buf);
+    sprintf(buf, "%" PRIu64, peak[OP_MEM_GETCONFIG]);
+    lyd_new_leaf(cont, NULL, "get-config-peak", buf);
+
+    /* shared reads */
+    op_get_shared_stats(&hits);
+    cont = lyd_new(np2, NULL, "shared-reads");
+    sprintf(buf, "%" PRIu64, hits);
+    lyd_new_leaf(cont, NULL, "hits", buf);
+
+    /* state cache */
+    if (op_state_cache_stats(&stats, &count)) {
+        return -1;
+    }
+    cont = lyd_new(np2, NULL, "state-cache");
+    for (i = 0; i < count; ++i) {
+        if (stats[i].xpath) {
+            list = lyd_new(cont, NULL, "subtree");
+            lyd_new_leaf(list, NULL, "xpath", stats[i].xpath);
+            sprintf(buf, "%" PRIu64, stats[i].hits);
+            lyd_new_leaf(list, NULL, "hits", buf);
+            sprintf(buf, "%" PRIu64, stats[i].misses);
+            lyd_new_leaf(list, NULL, "misses", buf);
+            if (stats[i].age > -1) {
+                sprintf(buf, "%" PRId64, stats[i].age);
+                lyd_new_leaf(list, NULL, "age", buf);
+            }
+        }
+        free(stats[i].xpath);
+    }
+    free(stats);
+
+    return 0;
+}
+
 struct lyd_node *
 ncm_get_data(void)
 {
@@ -336,6 +412,11 @@ ncm_get_data(void)
 
     pthread_mutex_unlock(&stats.lock);
 
+    /* netopeer2-server statistics, only if the module is installed */
+    if (ly_ctx_get_module(np2srv.ly_ctx, "netopeer2-server", NULL, 1) && ncm_get_server_data(root)) {
+        goto error;
+    }
+
     if (lyd_validate(&root, LYD_OPT_NOSIBLINGS, NULL)) {
         goto error;
     }
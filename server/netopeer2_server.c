@@ -0,0 +1,183 @@
+/**
+ * @file netopeer2_server.c
+ * @brief netopeer2-server netopeer2-server model subscription
+ *
+ * Copyright (c) 2026 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <nc_server.h>
+
+#include "common.h"
+#include "operations.h"
+
+/* read the whole state cache configuration */
+static int
+state_cache_apply(sr_session_ctx_t *srs)
+{
+    sr_val_iter_t *sr_iter;
+    sr_val_t *sr_val;
+    char **xpaths = NULL, *name;
+    uint32_t *ttls = NULL, count = 0, i;
+    void *mem;
+    int rc;
+
+    rc = np2srv_sr_get_items_iter(srs, "/netopeer2-server:netopeer2-server/state-cache/subtree/*", &sr_iter, NULL);
+    if (rc == 1) {
+        /* no subtrees */
+        return op_state_cache_configure(NULL, NULL, 0);
+    } else if (rc) {
+        return -1;
+    }
+
+    /* keys come first */
+    while (!np2srv_sr_get_item_next(srs, sr_iter, &sr_val, NULL)) {
+        name = strrchr(sr_val->xpath, '/') + 1;
+        if (!strcmp(name, "xpath")) {
+            mem = realloc(xpaths, (count + 1) * sizeof *xpaths);
+            if (!mem) {
+                sr_free_val(sr_val);
+                goto error;
+            }
+            xpaths = mem;
+            mem = realloc(ttls, (count + 1) * sizeof *ttls);
+            if (!mem) {
+                sr_free_val(sr_val);
+                goto error;
+            }
+            ttls = mem;
+
+            xpaths[count] = strdup(sr_val->data.string_val);
+            if (!xpaths[count]) {
+                sr_free_val(sr_val);
+                goto error;
+            }
+            ttls[count] = 0;
+            ++count;
+        } else if (!strcmp(name, "ttl") && count) {
+            ttls[count - 1] = sr_val->data.uint32_val;
+        }
+        sr_free_val(sr_val);
+    }
+    sr_free_val_iter(sr_iter);
+
+    VRB("State cache configured with %u subtree(s).", count);
+    rc = op_state_cache_configure(xpaths, ttls, count);
+    free(xpaths);
+    free(ttls);
+    return rc;
+
+error:
+    EMEM;
+    sr_free_val_iter(sr_iter);
+    for (i = 0; i < count; ++i) {
+        free(xpaths[i]);
+    }
+    free(xpaths);
+    free(ttls);
+    return -1;
+}
+
+/* read the edit-config settings */
+static int
+edit_config_apply(sr_session_ctx_t *srs)
+{
+    sr_val_iter_t *sr_iter;
+    sr_val_t *sr_val;
+    uint32_t delay = 0;
+    int rc;
+
+    rc = np2srv_sr_get_items_iter(srs, "/netopeer2-server:netopeer2-server/edit-config/*", &sr_iter, NULL);
+    if (rc == 1) {
+        /* nothing configured */
+        op_editconfig_group_configure(0);
+        return 0;
+    } else if (rc) {
+        return -1;
+    }
+
+    while (!np2srv_sr_get_item_next(srs, sr_iter, &sr_val, NULL)) {
+        if (!strcmp(strrchr(sr_val->xpath, '/') + 1, "group-commit-delay")) {
+            delay = sr_val->data.uint32_val;
+        }
+        sr_free_val(sr_val);
+    }
+    sr_free_val_iter(sr_iter);
+
+    VRB("Group commit delay of edit-config %u ms.", delay);
+    op_editconfig_group_configure(delay);
+    return 0;
+}
+
+/* read the copy-config settings */
+static int
+copy_config_apply(sr_session_ctx_t *srs)
+{
+    sr_val_iter_t *sr_iter;
+    sr_val_t *sr_val;
+    int rc, incremental = 0;
+
+    rc = np2srv_sr_get_items_iter(srs, "/netopeer2-server:netopeer2-server/copy-config/*", &sr_iter, NULL);
+    if (rc == 1) {
+        /* nothing configured */
+        op_copyconfig_incremental_configure(0);
+        return 0;
+    } else if (rc) {
+        return -1;
+    }
+
+    while (!np2srv_sr_get_item_next(srs, sr_iter, &sr_val, NULL)) {
+        if (!strcmp(strrchr(sr_val->xpath, '/') + 1, "incremental-startup")) {
+            incremental = sr_val->data.bool_val;
+        }
+        sr_free_val(sr_val);
+    }
+    sr_free_val_iter(sr_iter);
+
+    VRB("Copying running into startup %s.", incremental ? "incrementally" : "completely");
+    op_copyconfig_incremental_configure(incremental);
+    return 0;
+}
+
+static int
+module_change_cb(sr_session_ctx_t *srs, const char *UNUSED(module_name), sr_notif_event_t UNUSED(event),
+                 void *UNUSED(private_ctx))
+{
+    if (state_cache_apply(srs)) {
+        ERR("Failed to apply the state cache configuration.");
+    }
+    if (edit_config_apply(srs)) {
+        ERR("Failed to apply the edit-config configuration.");
+    }
+    if (copy_config_apply(srs)) {
+        ERR("Failed to apply the copy-config configuration.");
+    }
+
+    return SR_ERR_OK;
+}
+
+int
+netopeer2_server_init(const struct lys_module *UNUSED(module))
+{
+    if (np2srv_sr_module_change_subscribe(np2srv.sr_sess.srs, "netopeer2-server", module_change_cb, NULL, 0,
+            SR_SUBSCR_APPLY_ONLY | SR_SUBSCR_CTX_REUSE, &np2srv.sr_subscr, NULL)) {
+        return -1;
+    }
+
+    /* applies the whole current configuration */
+    if (state_cache_apply(np2srv.sr_sess.srs) || edit_config_apply(np2srv.sr_sess.srs)
+            || copy_config_apply(np2srv.sr_sess.srs)) {
+        return -1;
+    }
+    return 0;
+}
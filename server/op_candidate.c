@@ -12,6 +12,15 @@
  *     https://opensource.org/licenses/BSD-3-Clause
  */
 
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 #include <libyang/libyang.h>
 #include <nc_server.h>
 #include <sysrepo.h>
@@ -19,29 +28,530 @@
 #include "common.h"
 #include "operations.h"
 
+void
+op_cand_mark(struct np2_sessions *sessions, const char *module_name)
+{
+    char **mods;
+    uint16_t i;
+
+    sessions->flags |= NP2S_CAND_CHANGED;
+    if (sessions->flags & NP2S_CAND_ALL) {
+        return;
+    }
+
+    if (module_name) {
+        for (i = 0; i < sessions->cand_mod_count; ++i) {
+            if (!strcmp(sessions->cand_mods[i], module_name)) {
+                return;
+            }
+        }
+
+        mods = realloc(sessions->cand_mods, (sessions->cand_mod_count + 1) * sizeof *mods);
+        if (mods) {
+            sessions->cand_mods = mods;
+            mods[sessions->cand_mod_count] = strdup(module_name);
+            if (mods[sessions->cand_mod_count]) {
+                ++sessions->cand_mod_count;
+                return;
+            }
+        }
+        EMEM;
+    }
+
+    /* not tracked anymore */
+    for (i = 0; i < sessions->cand_mod_count; ++i) {
+        free(sessions->cand_mods[i]);
+    }
+    free(sessions->cand_mods);
+    sessions->cand_mods = NULL;
+    sessions->cand_mod_count = 0;
+    sessions->flags |= NP2S_CAND_ALL;
+}
+
+void
+op_cand_clear(struct np2_sessions *sessions)
+{
+    uint16_t i;
+
+    for (i = 0; i < sessions->cand_mod_count; ++i) {
+        free(sessions->cand_mods[i]);
+    }
+    free(sessions->cand_mods);
+    sessions->cand_mods = NULL;
+    sessions->cand_mod_count = 0;
+    sessions->flags &= ~(NP2S_CAND_CHANGED | NP2S_CAND_ALL);
+}
+
+/*
+ * Pending confirmed commit. The configuration of the modules changed by the confirmed commit(s) is kept
+ * as it was in running before, printed in XML, and restored by applying only its differences from
+ * the current running.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;
+    int rollback;               /* roll back as soon as possible */
+    int timer;                  /* timer thread is running */
+    uint32_t nc_id;             /* session that must confirm, 0 with persist */
+    char *persist;
+    struct timespec deadline;
+    struct confirmed_snapshot {
+        char *module;
+        char *data;             /* NULL if there were no data */
+    } *snapshots;
+    uint32_t count;
+} confirmed = {.lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER};
+
+static void
+confirmed_clear(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < confirmed.count; ++i) {
+        free(confirmed.snapshots[i].module);
+        free(confirmed.snapshots[i].data);
+    }
+    free(confirmed.snapshots);
+    confirmed.snapshots = NULL;
+    confirmed.count = 0;
+    free(confirmed.persist);
+    confirmed.persist = NULL;
+    confirmed.nc_id = 0;
+    confirmed.rollback = 0;
+    confirmed.pending = 0;
+
+    /* let the timer finish */
+    pthread_cond_broadcast(&confirmed.cond);
+}
+
+/* remember the running configuration of a module, if not already */
+static int
+confirmed_snapshot(sr_session_ctx_t *srs, const char *module_name)
+{
+    struct confirmed_snapshot *snap;
+    struct lyd_node *data = NULL;
+    char *xpath;
+    uint32_t i;
+    int rc;
+
+    for (i = 0; i < confirmed.count; ++i) {
+        if (!strcmp(confirmed.snapshots[i].module, module_name)) {
+            return 0;
+        }
+    }
+
+    if (asprintf(&xpath, "/%s:*//.", module_name) == -1) {
+        EMEM;
+        return -1;
+    }
+    rc = op_tree_builder_fetch(srs, &data, xpath, NULL);
+    free(xpath);
+    if (rc) {
+        lyd_free_withsiblings(data);
+        return -1;
+    }
+
+    snap = realloc(confirmed.snapshots, (confirmed.count + 1) * sizeof *snap);
+    if (!snap) {
+        EMEM;
+        lyd_free_withsiblings(data);
+        return -1;
+    }
+    confirmed.snapshots = snap;
+    snap = &confirmed.snapshots[confirmed.count];
+    snap->data = NULL;
+    if (data && lyd_print_mem(&snap->data, data, LYD_XML, LYP_WITHSIBLINGS)) {
+        lyd_free_withsiblings(data);
+        return -1;
+    }
+    lyd_free_withsiblings(data);
+    snap->module = strdup(module_name);
+    if (!snap->module) {
+        EMEM;
+        free(snap->data);
+        return -1;
+    }
+    ++confirmed.count;
+
+    return 0;
+}
+
+/* remember the running configuration of all the modules the commit of the candidate can change */
+static int
+confirmed_snapshot_cand(struct np2_sessions *sessions)
+{
+    sr_session_ctx_t *srs;
+    const struct op_mod_info *mods;
+    uint32_t count, i;
+    int rc, ret = 0;
+
+    if (!(sessions->flags & NP2S_CAND_CHANGED)) {
+        /* no changes */
+        return 0;
+    }
+
+    /* state data could not be parsed back */
+    rc = sr_session_start(np2srv.sr_conn, SR_DS_RUNNING, SR_SESS_CONFIG_ONLY, &srs);
+    if (rc != SR_ERR_OK) {
+        ERR("Starting a session for the confirmed commit failed (%s).", sr_strerror(rc));
+        return -1;
+    }
+
+    if (sessions->flags & NP2S_CAND_ALL) {
+        mods = op_mod_index(&count);
+        for (i = 0; !ret && (i < count); ++i) {
+            if (mods[i].flags & OP_MOD_CONFIG) {
+                ret = confirmed_snapshot(srs, mods[i].module->name);
+            }
+        }
+    } else {
+        for (i = 0; !ret && (i < sessions->cand_mod_count); ++i) {
+            ret = confirmed_snapshot(srs, sessions->cand_mods[i]);
+        }
+    }
+
+    np2srv_sr_session_stop(srs, NULL);
+    return ret;
+}
+
+/* restore running from the snapshots, MUST be called holding the libyang context lock */
+static void
+confirmed_rollback(void)
+{
+    sr_session_ctx_t *srs;
+    struct lyd_node *current, *data;
+    char *xpath;
+    uint32_t i, changes, total = 0;
+    int rc;
+
+    rc = sr_session_start(np2srv.sr_conn, SR_DS_RUNNING, SR_SESS_CONFIG_ONLY, &srs);
+    if (rc != SR_ERR_OK) {
+        ERR("Starting a session for the confirmed commit rollback failed (%s).", sr_strerror(rc));
+        return;
+    }
+
+    for (i = 0; !rc && (i < confirmed.count); ++i) {
+        data = NULL;
+        if (confirmed.snapshots[i].data) {
+            /* it was valid data */
+            data = lyd_parse_mem(np2srv.ly_ctx, confirmed.snapshots[i].data, LYD_XML, LYD_OPT_CONFIG | LYD_OPT_TRUSTED);
+            if (!data) {
+                ERR("Confirmed commit snapshot of module \"%s\" cannot be parsed.", confirmed.snapshots[i].module);
+                rc = -1;
+                break;
+            }
+        }
+
+        if (asprintf(&xpath, "/%s:*//.", confirmed.snapshots[i].module) == -1) {
+            EMEM;
+            lyd_free_withsiblings(data);
+            rc = -1;
+            break;
+        }
+        current = NULL;
+        rc = op_tree_builder_fetch(srs, &current, xpath, NULL);
+        if (!rc) {
+            /* path of all the module data */
+            xpath[strlen(xpath) - 3] = '\0';
+            changes = 0;
+            rc = op_tree_replace(srs, xpath, current, data, &changes, NULL);
+            total += changes;
+            if (changes) {
+                op_startup_mark(confirmed.snapshots[i].module);
+            }
+        }
+        free(xpath);
+        lyd_free_withsiblings(current);
+        lyd_free_withsiblings(data);
+    }
+
+    if (!rc) {
+        rc = np2srv_sr_commit(srs, NULL);
+    }
+    if (rc) {
+        ERR("Rolling back the confirmed commit failed, running was not restored.");
+        np2srv_sr_discard_changes(srs, NULL);
+    } else {
+        VRB("Confirmed commit rolled back with %u change(s).", total);
+    }
+    np2srv_sr_session_stop(srs, NULL);
+}
+
+static int
+confirmed_expired(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (now.tv_sec > confirmed.deadline.tv_sec)
+            || ((now.tv_sec == confirmed.deadline.tv_sec) && (now.tv_nsec >= confirmed.deadline.tv_nsec));
+}
+
+static void *
+confirmed_timer(void *UNUSED(arg))
+{
+    pthread_mutex_lock(&confirmed.lock);
+    while (confirmed.pending) {
+        if (!confirmed.rollback && !confirmed_expired()) {
+            pthread_cond_timedwait(&confirmed.cond, &confirmed.lock, &confirmed.deadline);
+            continue;
+        }
+
+        /* keep the lock order of the RPC callbacks */
+        pthread_mutex_unlock(&confirmed.lock);
+        pthread_rwlock_rdlock(&np2srv.ly_ctx_lock);
+        pthread_mutex_lock(&confirmed.lock);
+
+        if (!np2srv.ly_ctx) {
+            /* server is being stopped */
+            pthread_rwlock_unlock(&np2srv.ly_ctx_lock);
+            break;
+        }
+        if (confirmed.pending && (confirmed.rollback || confirmed_expired())) {
+            VRB("Confirmed commit %s, rolling back.", confirmed.rollback ? "canceled" : "timed out");
+            confirmed_rollback();
+            confirmed_clear();
+        }
+        pthread_rwlock_unlock(&np2srv.ly_ctx_lock);
+    }
+    confirmed.timer = 0;
+    pthread_cond_broadcast(&confirmed.cond);
+    pthread_mutex_unlock(&confirmed.lock);
+
+    return NULL;
+}
+
+/* check that the session can confirm, extend, or cancel the pending confirmed commit */
+static struct nc_server_reply *
+confirmed_check(struct nc_session *ncs, struct lyd_node *persist_id)
+{
+    struct nc_server_error *e;
+    const char *msg;
+
+    if (!confirmed.pending) {
+        if (!persist_id) {
+            return NULL;
+        }
+        msg = "No confirmed commit with the persist-id is pending.";
+        e = nc_err(NC_ERR_INVALID_VALUE, NC_ERR_TYPE_PROT);
+    } else if (confirmed.persist) {
+        if (persist_id && !strcmp(((struct lyd_node_leaf_list *)persist_id)->value_str, confirmed.persist)) {
+            return NULL;
+        }
+        msg = "The persist-id does not match the pending confirmed commit.";
+        e = nc_err(NC_ERR_INVALID_VALUE, NC_ERR_TYPE_PROT);
+    } else if (persist_id) {
+        msg = "The pending confirmed commit has no persist-id.";
+        e = nc_err(NC_ERR_INVALID_VALUE, NC_ERR_TYPE_PROT);
+    } else if (confirmed.nc_id != nc_session_get_id(ncs)) {
+        msg = "Confirmed commit of another session is pending.";
+        e = nc_err(NC_ERR_IN_USE, NC_ERR_TYPE_PROT);
+    } else {
+        return NULL;
+    }
+
+    nc_err_set_msg(e, msg, "en");
+    return nc_server_reply_err(e);
+}
+
+int
+op_confirmed_other(struct nc_session *ncs)
+{
+    int ret;
+
+    pthread_mutex_lock(&confirmed.lock);
+    ret = confirmed.pending && confirmed.nc_id && (confirmed.nc_id != nc_session_get_id(ncs));
+    pthread_mutex_unlock(&confirmed.lock);
+
+    return ret;
+}
+
+void
+op_confirmed_session_end(struct nc_session *ncs)
+{
+    pthread_mutex_lock(&confirmed.lock);
+    if (confirmed.pending && confirmed.nc_id && (confirmed.nc_id == nc_session_get_id(ncs))) {
+        /* not confirmed, the timer will roll it back */
+        confirmed.rollback = 1;
+        pthread_cond_broadcast(&confirmed.cond);
+    }
+    pthread_mutex_unlock(&confirmed.lock);
+}
+
+void
+op_confirmed_stop(void)
+{
+    pthread_mutex_lock(&confirmed.lock);
+    if (confirmed.pending) {
+        confirmed.rollback = 1;
+        pthread_cond_broadcast(&confirmed.cond);
+    }
+    while (confirmed.timer) {
+        pthread_cond_wait(&confirmed.cond, &confirmed.lock);
+    }
+    if (confirmed.pending) {
+        /* the timer gave up */
+        confirmed_clear();
+    }
+    pthread_mutex_unlock(&confirmed.lock);
+}
+
 struct nc_server_reply *
-op_commit(struct lyd_node *UNUSED(rpc), struct nc_session *ncs)
+op_commit(struct lyd_node *rpc, struct nc_session *ncs)
 {
     struct np2_sessions *sessions;
     struct nc_server_reply *ereply = NULL;
+    struct nc_server_error *e;
+    struct lyd_node *node, *persist;
+    pthread_t tid;
+    uint32_t timeout = 600, count;
+    uint16_t i;
+    int was_pending;
 
     /* get sysrepo connections for this session */
     sessions = (struct np2_sessions *)nc_session_get_data(ncs);
 
     if (np2srv_sr_check_exec_permission(sessions->srs, "/ietf-netconf:commit", &ereply)) {
-        goto finish;
+        return ereply;
     }
 
-    if (np2srv_sr_copy_config(sessions->srs, NULL, SR_DS_CANDIDATE, SR_DS_RUNNING, &ereply)) {
+    pthread_mutex_lock(&confirmed.lock);
+
+    ereply = confirmed_check(ncs, op_param_get(rpc, OP_PARAM_COMMIT_PERSISTID));
+    if (ereply) {
         goto finish;
     }
+    was_pending = confirmed.pending;
+    count = confirmed.count;
+
+    if (op_param_get(rpc, OP_PARAM_COMMIT_CONFIRMED)) {
+        /* keep the current running of everything that is going to change */
+        if (confirmed_snapshot_cand(sessions)) {
+            goto internalerror;
+        }
+    }
+
+    if (!(sessions->flags & NP2S_CAND_ALL) && (sessions->cand_mod_count == 1)) {
+        /* only a single module changed, the copy is atomic anyway */
+        DBG("COMMIT: copying only module \"%s\".", sessions->cand_mods[0]);
+        if (np2srv_sr_copy_config(sessions->srs, sessions->cand_mods[0], SR_DS_CANDIDATE, SR_DS_RUNNING, &ereply)) {
+            goto error;
+        }
+    } else if (np2srv_sr_copy_config(sessions->srs, NULL, SR_DS_CANDIDATE, SR_DS_RUNNING, &ereply)) {
+        goto error;
+    }
+
+    /* running differs from startup in the committed modules */
+    if (sessions->flags & NP2S_CAND_ALL) {
+        op_startup_mark(NULL);
+    } else {
+        for (i = 0; i < sessions->cand_mod_count; ++i) {
+            op_startup_mark(sessions->cand_mods[i]);
+        }
+    }
 
     /* remove modify flag */
-    sessions->flags &= ~NP2S_CAND_CHANGED;
+    op_cand_clear(sessions);
+
+    if (op_param_get(rpc, OP_PARAM_COMMIT_CONFIRMED)) {
+        /* (re)start the confirm timeout */
+        node = op_param_get(rpc, OP_PARAM_COMMIT_TIMEOUT);
+        if (node) {
+            timeout = ((struct lyd_node_leaf_list *)node)->value.uint32;
+        }
+        clock_gettime(CLOCK_REALTIME, &confirmed.deadline);
+        confirmed.deadline.tv_sec += timeout;
+
+        free(confirmed.persist);
+        confirmed.persist = NULL;
+        persist = op_param_get(rpc, OP_PARAM_COMMIT_PERSIST);
+        if (persist) {
+            confirmed.persist = strdup(((struct lyd_node_leaf_list *)persist)->value_str);
+            if (!confirmed.persist) {
+                EMEM;
+            }
+        }
+        confirmed.nc_id = persist ? 0 : nc_session_get_id(ncs);
+        confirmed.pending = 1;
+
+        if (!confirmed.timer) {
+            if (pthread_create(&tid, NULL, confirmed_timer, NULL)) {
+                ERR("Creating the confirmed commit timer failed.");
+                confirmed_rollback();
+                confirmed_clear();
+                goto internalerror;
+            }
+            pthread_detach(tid);
+            confirmed.timer = 1;
+        } else {
+            pthread_cond_broadcast(&confirmed.cond);
+        }
+        VRB("Confirmed commit %s, timeout %u s.", was_pending ? "extended" : "started", timeout);
+    } else if (was_pending) {
+        VRB("Confirmed commit confirmed.");
+        confirmed_clear();
+    }
+
+    ereply = nc_server_reply_ok();
+    goto finish;
+
+internalerror:
+    e = nc_err(NC_ERR_OP_FAILED, NC_ERR_TYPE_APP);
+    nc_err_set_msg(e, np2log_lasterr(), "en");
+    ereply = nc_server_reply_err(e);
+
+error:
+    /* forget the snapshots of this commit, running was not changed */
+    while (confirmed.count > count) {
+        --confirmed.count;
+        free(confirmed.snapshots[confirmed.count].module);
+        free(confirmed.snapshots[confirmed.count].data);
+    }
+    if (!was_pending && !confirmed.pending) {
+        confirmed_clear();
+    }
+
+finish:
+    pthread_mutex_unlock(&confirmed.lock);
+    return ereply;
+}
+
+struct nc_server_reply *
+op_cancelcommit(struct lyd_node *rpc, struct nc_session *ncs)
+{
+    struct np2_sessions *sessions;
+    struct nc_server_reply *ereply = NULL;
+    struct nc_server_error *e;
+
+    /* get sysrepo connections for this session */
+    sessions = (struct np2_sessions *)nc_session_get_data(ncs);
+
+    if (np2srv_sr_check_exec_permission(sessions->srs, "/ietf-netconf:cancel-commit", &ereply)) {
+        return ereply;
+    }
+
+    pthread_mutex_lock(&confirmed.lock);
+
+    ereply = confirmed_check(ncs, op_param_get(rpc, OP_PARAM_CANCEL_PERSISTID));
+    if (ereply) {
+        goto finish;
+    }
+    if (!confirmed.pending) {
+        e = nc_err(NC_ERR_OP_FAILED, NC_ERR_TYPE_PROT);
+        nc_err_set_msg(e, "No confirmed commit is pending.", "en");
+        ereply = nc_server_reply_err(e);
+        goto finish;
+    }
+
+    VRB("Confirmed commit canceled, rolling back.");
+    confirmed_rollback();
+    confirmed_clear();
 
     ereply = nc_server_reply_ok();
 
 finish:
+    pthread_mutex_unlock(&confirmed.lock);
     return ereply;
 }
 
@@ -69,7 +579,7 @@ op_discardchanges(struct lyd_node *UNUSED(rpc), struct nc_session *ncs)
     }
 
     /* remove modify flag */
-    sessions->flags &= ~NP2S_CAND_CHANGED;
+    op_cand_clear(sessions);
 
     ereply = nc_server_reply_ok();
 
@@ -28,20 +28,228 @@
 #include "common.h"
 #include "operations.h"
 
+/* modules changed in running since the last copy of running into startup */
+static struct {
+    pthread_mutex_t lock;
+    int enabled;
+    int all;                /* changes are not known, everything must be copied */
+    char **changed;
+    uint32_t count;
+    char **subscribed;      /* modules with a change subscription */
+    uint32_t sub_count;
+} copy_startup = {.lock = PTHREAD_MUTEX_INITIALIZER, .all = 1};
+
+/* MUST be called holding the lock */
+static void
+copy_startup_forget(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < copy_startup.count; ++i) {
+        free(copy_startup.changed[i]);
+    }
+    free(copy_startup.changed);
+    copy_startup.changed = NULL;
+    copy_startup.count = 0;
+}
+
+void
+op_copyconfig_incremental_configure(int enable)
+{
+    pthread_mutex_lock(&copy_startup.lock);
+    if (enable && !copy_startup.enabled) {
+        /* the changes were not tracked */
+        copy_startup_forget();
+        copy_startup.all = 1;
+    }
+    copy_startup.enabled = enable;
+    pthread_mutex_unlock(&copy_startup.lock);
+}
+
+void
+op_startup_mark(const char *module_name)
+{
+    char **changed;
+    uint32_t i;
+
+    pthread_mutex_lock(&copy_startup.lock);
+    if (!copy_startup.enabled || copy_startup.all) {
+        goto cleanup;
+    }
+
+    if (module_name) {
+        for (i = 0; i < copy_startup.count; ++i) {
+            if (!strcmp(copy_startup.changed[i], module_name)) {
+                goto cleanup;
+            }
+        }
+
+        changed = realloc(copy_startup.changed, (copy_startup.count + 1) * sizeof *changed);
+        if (changed) {
+            copy_startup.changed = changed;
+            changed[copy_startup.count] = strdup(module_name);
+            if (changed[copy_startup.count]) {
+                ++copy_startup.count;
+                goto cleanup;
+            }
+        }
+        EMEM;
+    }
+
+    /* not tracked anymore */
+    copy_startup_forget();
+    copy_startup.all = 1;
+
+cleanup:
+    pthread_mutex_unlock(&copy_startup.lock);
+}
+
+void
+op_startup_reset(void)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&copy_startup.lock);
+    copy_startup_forget();
+    copy_startup.all = 1;
+    for (i = 0; i < copy_startup.sub_count; ++i) {
+        free(copy_startup.subscribed[i]);
+    }
+    free(copy_startup.subscribed);
+    copy_startup.subscribed = NULL;
+    copy_startup.sub_count = 0;
+    pthread_mutex_unlock(&copy_startup.lock);
+}
+
+static int
+copy_startup_change_cb(sr_session_ctx_t *UNUSED(session), const char *module_name, sr_notif_event_t UNUSED(event),
+                       void *UNUSED(private_ctx))
+{
+    /* changed by someone else than a NETCONF session */
+    op_startup_mark(module_name);
+    return SR_ERR_OK;
+}
+
+/* make sure the changes of the module are tracked, a newly subscribed module is considered changed */
+static int
+copy_startup_subscribe(const char *module_name)
+{
+    char **subscribed;
+    uint32_t i;
+
+    pthread_mutex_lock(&copy_startup.lock);
+    for (i = 0; i < copy_startup.sub_count; ++i) {
+        if (!strcmp(copy_startup.subscribed[i], module_name)) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&copy_startup.lock);
+    if (i < copy_startup.sub_count) {
+        return 0;
+    }
+
+    /* cannot hold the lock, sysrepo may reconnect and reset the tracking */
+    if (np2srv_sr_module_change_subscribe(np2srv.sr_sess.srs, module_name, copy_startup_change_cb, NULL, 0,
+            SR_SUBSCR_PASSIVE | SR_SUBSCR_APPLY_ONLY | SR_SUBSCR_CTX_REUSE, &np2srv.sr_subscr, NULL)) {
+        return -1;
+    }
+    op_startup_mark(module_name);
+
+    pthread_mutex_lock(&copy_startup.lock);
+    subscribed = realloc(copy_startup.subscribed, (copy_startup.sub_count + 1) * sizeof *subscribed);
+    if (!subscribed) {
+        pthread_mutex_unlock(&copy_startup.lock);
+        EMEM;
+        return -1;
+    }
+    copy_startup.subscribed = subscribed;
+    subscribed[copy_startup.sub_count] = strdup(module_name);
+    if (!subscribed[copy_startup.sub_count]) {
+        pthread_mutex_unlock(&copy_startup.lock);
+        EMEM;
+        return -1;
+    }
+    ++copy_startup.sub_count;
+    pthread_mutex_unlock(&copy_startup.lock);
+
+    return 0;
+}
+
+/* copy running into startup, only the modules changed since the last copy if the changes are tracked,
+ * 1 returned if they are not */
+static int
+copy_startup_incremental(sr_session_ctx_t *srs, struct nc_server_reply **ereply)
+{
+    const struct op_mod_info *mods;
+    char **changed;
+    uint32_t count, i;
+    int enabled, all, rc = 0;
+
+    pthread_mutex_lock(&copy_startup.lock);
+    enabled = copy_startup.enabled;
+    pthread_mutex_unlock(&copy_startup.lock);
+    if (!enabled) {
+        return 1;
+    }
+
+    /* subscribe before copying so that no change is missed */
+    mods = op_mod_index(&count);
+    for (i = 0; i < count; ++i) {
+        if (mods[i].module->implemented && (mods[i].flags & OP_MOD_CONFIG)
+                && copy_startup_subscribe(mods[i].module->name)) {
+            return -1;
+        }
+    }
+
+    /* the changes made from now on will be copied next time */
+    pthread_mutex_lock(&copy_startup.lock);
+    all = copy_startup.all;
+    changed = copy_startup.changed;
+    count = copy_startup.count;
+    copy_startup.all = 0;
+    copy_startup.changed = NULL;
+    copy_startup.count = 0;
+    pthread_mutex_unlock(&copy_startup.lock);
+
+    if (all) {
+        rc = np2srv_sr_copy_config(srs, NULL, SR_DS_RUNNING, SR_DS_STARTUP, ereply);
+    } else {
+        for (i = 0; !rc && (i < count); ++i) {
+            rc = np2srv_sr_copy_config(srs, changed[i], SR_DS_RUNNING, SR_DS_STARTUP, ereply);
+        }
+    }
+
+    if (rc) {
+        /* startup was changed only partially */
+        op_startup_mark(NULL);
+    } else if (all) {
+        VRB("copy-config: all the modules copied into startup.");
+    } else {
+        VRB("copy-config: %u module(s) changed since the last copy copied into startup.", count);
+    }
+
+    for (i = 0; i < count; ++i) {
+        free(changed[i]);
+    }
+    free(changed);
+    return rc;
+}
+
 struct nc_server_reply *
 op_copyconfig(struct lyd_node *rpc, struct nc_session *ncs)
 {
     struct np2_sessions *sessions;
     sr_datastore_t target = 0, source = 0;
     struct ly_set *nodeset;
-    struct lyd_node *config = NULL, *iter, *next;
+    struct lyd_node *config = NULL, *data = NULL, *current = NULL, *iter, *next, *src;
     struct lyd_node_anydata *any;
+    struct lys_module *mod;
     const char *dsname;
-    char *str, path[1024];
-    sr_val_t value;
+    char *str;
     struct nc_server_error *e;
     struct nc_server_reply *ereply = NULL;
-    int rc = SR_ERR_OK, path_index = 0, missing_keys = 0, lastkey = 0;
+    int rc = SR_ERR_OK;
+    uint32_t changes;
     unsigned int i;
 
     /* get sysrepo connections for this session */
@@ -52,9 +260,7 @@ op_copyconfig(struct lyd_node *rpc, struct nc_session *ncs)
     }
 
     /* get know which datastore is being affected */
-    nodeset = lyd_find_path(rpc, "/ietf-netconf:copy-config/target/*");
-    dsname = nodeset->set.d[0]->schema->name;
-    ly_set_free(nodeset);
+    dsname = op_param_get(rpc, OP_PARAM_COPY_TARGET)->child->schema->name;
 
     if (!strcmp(dsname, "running")) {
         target = SR_DS_RUNNING;
@@ -78,8 +284,8 @@ op_copyconfig(struct lyd_node *rpc, struct nc_session *ncs)
     }
 
     /* get source */
-    nodeset = lyd_find_path(rpc, "/ietf-netconf:copy-config/source/*");
-    dsname = nodeset->set.d[0]->schema->name;
+    src = op_param_get(rpc, OP_PARAM_COPY_SOURCE)->child;
+    dsname = src->schema->name;
 
     if (!strcmp(dsname, "running")) {
         source = SR_DS_RUNNING;
@@ -88,7 +294,7 @@ op_copyconfig(struct lyd_node *rpc, struct nc_session *ncs)
     } else if (!strcmp(dsname, "candidate")) {
         source = SR_DS_CANDIDATE;
     } else if (!strcmp(dsname, "config")) {
-        any = (struct lyd_node_anydata *)nodeset->set.d[0];
+        any = (struct lyd_node_anydata *)src;
         switch (any->value_type) {
         case LYD_ANYDATA_CONSTSTRING:
         case LYD_ANYDATA_STRING:
@@ -106,7 +312,6 @@ op_copyconfig(struct lyd_node *rpc, struct nc_session *ncs)
         case LYD_ANYDATA_JSOND:
         case LYD_ANYDATA_SXMLD:
             EINT;
-            ly_set_free(nodeset);
             e = nc_err(NC_ERR_OP_FAILED, NC_ERR_TYPE_APP);
             nc_err_set_msg(e, np2log_lasterr(), "en");
             ereply = nc_server_reply_err(e);
@@ -114,7 +319,6 @@ op_copyconfig(struct lyd_node *rpc, struct nc_session *ncs)
         }
         if (!config) {
             if (ly_errno != LY_SUCCESS) {
-                ly_set_free(nodeset);
                 e = nc_err(NC_ERR_OP_FAILED, NC_ERR_TYPE_APP);
                 nc_err_set_msg(e, np2log_lasterr(), "en");
                 ereply = nc_server_reply_err(e);
@@ -125,169 +329,99 @@ op_copyconfig(struct lyd_node *rpc, struct nc_session *ncs)
         }
     }
     /* TODO URL capability */
-    ly_set_free(nodeset);
 
     /* perform operation */
     if (config) {
-        /* remove all the data from the models mentioned in the <config> ... */
+        /* the current data are compared with the configuration, state data must not be read */
+        if (op_sessions_config_only(sessions, &ereply)) {
+            goto finish;
+        }
+
+        /* the data of all the models mentioned in the <config> are replaced ... */
         nodeset = ly_set_new();
+        if (!nodeset) {
+            EMEM;
+            goto internalerror;
+        }
         LY_TREE_FOR(config, iter) {
             if (iter->dflt) {
                 continue;
             }
             ly_set_add(nodeset, lyd_node_module(iter), 0);
         }
+
+        /* ... by applying only the differences from their current data, module by module */
         for (i = 0; i < nodeset->number; i++) {
-            snprintf(path, 1024, "/%s:*", ((struct lys_module *)nodeset->set.g[i])->name);
-            np2srv_sr_delete_item(sessions->srs, path, 0, NULL);
-        }
-        ly_set_free(nodeset);
+            mod = (struct lys_module *)nodeset->set.g[i];
 
-        /* and copy <config>'s content into sysrepo */
-        LY_TREE_DFS_BEGIN(config, next, iter) {
-            /* maintain path */
-            if (!missing_keys) {
-                if (!iter->parent || lyd_node_module(iter) != lyd_node_module(iter->parent)) {
-                    /* with prefix */
-                    path_index += sprintf(&path[path_index], "/%s:%s", lyd_node_module(iter)->name, iter->schema->name);
-                } else {
-                    /* without prefix */
-                    path_index += sprintf(&path[path_index], "/%s", iter->schema->name);
+            /* move the module data into a separate tree */
+            LY_TREE_FOR_SAFE(config, next, iter) {
+                if (lyd_node_module(iter) != mod) {
+                    continue;
                 }
-
-                /* erase value */
-                memset(&value, 0, sizeof value);
-            }
-
-            /* specific handling for different types of nodes */
-            lastkey = 0;
-
-            /* skip default nodes */
-            if (iter->dflt) {
-                goto dfs_continue;
-            }
-
-            switch(iter->schema->nodetype) {
-            case LYS_CONTAINER:
-                if (!((struct lys_node_container *)iter->schema)->presence) {
-                    /* do nothing */
-                    goto dfs_continue;
+                if (iter == config) {
+                    config = iter->next;
                 }
-                /* set value for sysrepo */
-                op_set_srval(iter, NULL, 0, &value, &str);
-
-                break;
-            case LYS_LEAF:
-                if (missing_keys) {
-                    /* still processing list keys */
-                    missing_keys--;
-                    /* add key predicate into the list's path */
-                    path_index += sprintf(&path[path_index], "[%s=\'%s\']", iter->schema->name,
-                                          ((struct lyd_node_leaf_list *)iter)->value_str);
-                    if (!missing_keys) {
-                        /* the last key, create the list instance */
-                        lastkey = 1;
-                        break;
-                    }
-                    goto dfs_continue;
+                lyd_unlink(iter);
+                if (!data) {
+                    data = iter;
+                } else {
+                    lyd_insert_sibling(&data, iter);
                 }
-                /* regular leaf */
-
-                /* set value for sysrepo */
-                op_set_srval(iter, NULL, 0, &value, &str);
-
-                break;
-            case LYS_LEAFLIST:
-                /* set value for sysrepo */
-                op_set_srval(iter, NULL, 0, &value, &str);
-
-                break;
-            case LYS_LIST:
-                /* set value for sysrepo, it will be used as soon as all the keys are processed */
-                op_set_srval(iter, NULL, 0, &value, &str);
-
-                /* the creation must be finished later when we get know keys */
-                missing_keys = ((struct lys_node_list *)iter->schema)->keys_size;
-                goto dfs_continue;
-            case LYS_ANYXML:
-                /* set value for sysrepo */
-                op_set_srval(iter, NULL, 0, &value, &str);
-
-                break;
-            default:
-                ERR("%s: Invalid node to process", __func__);
-                e = nc_err(NC_ERR_OP_FAILED, NC_ERR_TYPE_APP);
-                nc_err_set_msg(e, np2log_lasterr(), "en");
-                ereply = nc_server_reply_err(e);
-                goto finish;
-            }
-
-            /* create the iter in sysrepo */
-            rc = np2srv_sr_set_item(sessions->srs, path, &value, 0, &ereply);
-            if (str) {
-                free(str);
-                str = NULL;
-            }
-            if (rc) {
-                goto finish;
             }
 
-dfs_continue:
-            /* modified LY_TREE_DFS_END,
-             * select iter for the next run - children first */
-            if (iter->schema->nodetype & (LYS_LEAF | LYS_LEAFLIST | LYS_ANYXML)) {
-                next = NULL;
-            } else {
-                next = iter->child;
+            if (asprintf(&str, "/%s:*//.", mod->name) == -1) {
+                EMEM;
+                ly_set_free(nodeset);
+                goto internalerror;
             }
-
-            if (!next) {
-                /* no children, try siblings */
-                next = iter->next;
-
-                /* maintain "stack" variables */
-                if (!missing_keys && !lastkey) {
-                    str = strrchr(path, '/');
-                    if (str) {
-                        *str = '\0';
-                        path_index = str - path;
-                    } else {
-                        path[0] = '\0';
-                        path_index = 0;
-                    }
-                }
+            rc = op_tree_builder_fetch(sessions->srs, &current, str, NULL);
+            if (!rc) {
+                /* path of all the module data */
+                str[strlen(str) - 3] = '\0';
+                rc = op_tree_replace(sessions->srs, str, current, data, &changes, &ereply);
             }
-
-            while (!next) {
-                /* parent is already processed, go to its sibling */
-                iter = iter->parent;
-                if (iter == config->parent) {
-                    /* we are done, no next element to process */
-                    break;
+            free(str);
+            lyd_free_withsiblings(current);
+            current = NULL;
+            lyd_free_withsiblings(data);
+            data = NULL;
+            if (rc) {
+                ly_set_free(nodeset);
+                if (!ereply) {
+                    goto internalerror;
                 }
-                next = iter->next;
-
-                /* maintain "stack" variables */
-                if (!missing_keys) {
-                    str = strrchr(path, '/');
-                    if (str) {
-                        *str = '\0';
-                        path_index = str - path;
-                    } else {
-                        path[0] = '\0';
-                        path_index = 0;
-                    }
+                np2srv_sr_discard_changes(sessions->srs, NULL);
+                if (sessions->ds == SR_DS_CANDIDATE) {
+                    op_cand_clear(sessions);
                 }
+                goto finish;
+            }
+            VRB("copy-config: module \"%s\" copied with %u change(s) (%u/%u).", mod->name, changes, i + 1,
+                nodeset->number);
+            if (changes && (sessions->ds == SR_DS_CANDIDATE)) {
+                op_cand_mark(sessions, mod->name);
+            } else if (changes) {
+                op_startup_mark(mod->name);
             }
         }
+        ly_set_free(nodeset);
 
         /* commit the result */
         rc = np2srv_sr_commit(sessions->srs, &ereply);
-    } else {
+    } else if ((source != SR_DS_RUNNING) || (target != SR_DS_STARTUP)
+            || ((rc = copy_startup_incremental(sessions->srs, &ereply)) == 1)) {
         rc = np2srv_sr_copy_config(sessions->srs, NULL, source, target, &ereply);
         /* commit is done implicitely by sr_copy_config() */
+        if (!rc && (target != SR_DS_CANDIDATE)) {
+            /* any module can differ between running and startup now */
+            op_startup_mark(NULL);
+        }
     }
     if (rc) {
+        if (!ereply) {
+            goto internalerror;
+        }
         goto finish;
     }
 
@@ -295,10 +429,16 @@ dfs_continue:
         if (np2srv_sr_validate(sessions->srs, &ereply)) {
             /* content is not valid or error, rollback */
             np2srv_sr_discard_changes(sessions->srs, NULL);
+            op_cand_clear(sessions);
             goto finish;
         }
-        /* mark candidate as modified */
-        sessions->flags |= NP2S_CAND_CHANGED;
+        if (strcmp(dsname, "config")) {
+            /* any module can be changed by the copy of another datastore */
+            op_cand_mark(sessions, NULL);
+        } else {
+            /* modules were marked as they were copied */
+            sessions->flags |= NP2S_CAND_CHANGED;
+        }
     }
 
     ereply = nc_server_reply_ok();
@@ -306,4 +446,15 @@ dfs_continue:
 finish:
     lyd_free_withsiblings(config);
     return ereply;
+
+internalerror:
+    e = nc_err(NC_ERR_OP_FAILED, NC_ERR_TYPE_APP);
+    nc_err_set_msg(e, np2log_lasterr(), "en");
+    ereply = nc_server_reply_err(e);
+    np2srv_sr_discard_changes(sessions->srs, NULL);
+    if (sessions->ds == SR_DS_CANDIDATE) {
+        op_cand_clear(sessions);
+    }
+    lyd_free_withsiblings(config);
+    return ereply;
 }
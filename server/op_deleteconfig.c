@@ -27,11 +27,9 @@ op_deleteconfig(struct lyd_node *rpc, struct nc_session *ncs)
     struct np2_sessions *sessions;
     sr_datastore_t target = 0;
     const char *dsname;
-    uint32_t index;
-    const struct lys_module *mod;
-    struct lys_node *iter;
+    uint32_t i, mod_count;
+    const struct op_mod_info *mods;
     char path[1024];
-    struct ly_set *nodeset;
     struct nc_server_reply *ereply = NULL;
 
     /* get sysrepo connections for this session */
@@ -42,9 +40,7 @@ op_deleteconfig(struct lyd_node *rpc, struct nc_session *ncs)
     }
 
     /* get know which datastore is being affected */
-    nodeset = lyd_find_path(rpc, "/ietf-netconf:delete-config/target/*");
-    dsname = nodeset->set.d[0]->schema->name;
-    ly_set_free(nodeset);
+    dsname = op_param_get(rpc, OP_PARAM_DELETE_TARGET)->child->schema->name;
 
     if (!strcmp(dsname, "startup")) {
         target = SR_DS_STARTUP;
@@ -67,24 +63,18 @@ op_deleteconfig(struct lyd_node *rpc, struct nc_session *ncs)
     /* perform operation
      * - iterate over all schemas and remove all top-level data nodes.
      * sysrepo does not accept '/\asterisk' since it splits data */
-    index = 0;
-    while ((mod = ly_ctx_get_module_iter(np2srv.ly_ctx, &index))) {
-        LY_TREE_FOR(mod->data, iter) {
-            if (!(iter->nodetype & (LYS_CONTAINER | LYS_LIST | LYS_LEAFLIST | LYS_LEAF | LYS_ANYXML)) ||
-                    (iter->flags & LYS_CONFIG_R)) {
-                /* skip bothering sysrepo with schemas with no configuration data */
-                continue;
-            }
-
-            snprintf(path, 1024, "/%s:*", mod->name);
-            if (np2srv_sr_delete_item(sessions->srs, path, 0, &ereply)) {
-                np2srv_sr_discard_changes(sessions->srs, NULL);
-                goto finish;
-            }
-
-            /* sysrepo was asked for remove all configuration data
-             * from this schema so we can continue with another schema */
-            break;
+    mods = op_mod_index(&mod_count);
+    for (i = 0; i < mod_count; ++i) {
+        if (!(mods[i].flags & OP_MOD_CONFIG)) {
+            /* skip bothering sysrepo with schemas with no configuration data */
+            continue;
+        }
+
+        /* remove all configuration data from this schema */
+        snprintf(path, 1024, "/%s:*", mods[i].module->name);
+        if (np2srv_sr_delete_item(sessions->srs, path, 0, &ereply)) {
+            np2srv_sr_discard_changes(sessions->srs, NULL);
+            goto finish;
         }
     }
 
@@ -94,6 +84,9 @@ op_deleteconfig(struct lyd_node *rpc, struct nc_session *ncs)
         goto finish;
     }
 
+    /* startup differs from running everywhere */
+    op_startup_mark(NULL);
+
     ereply = nc_server_reply_ok();
 
 finish:
@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 
 #include <libyang/libyang.h>
 #include <nc_server.h>
@@ -83,7 +84,7 @@ cleanup:
 }
 
 static int
-edit_get_move(struct lyd_node *node, const char *path, sr_move_position_t *pos, char **rel)
+edit_get_move(struct lyd_node *node, const char *path, sr_move_position_t *pos, char **rel, struct op_arena *arena)
 {
     const char *name, *format;
     struct lyd_attr *attr_iter;
@@ -109,9 +110,8 @@ edit_get_move(struct lyd_node *node, const char *path, sr_move_position_t *pos,
                     *pos = SR_MOVE_AFTER;
                 }
             } else if (!strcmp(attr_iter->name, name)) {
-                if (asprintf(rel, format, path, attr_iter->value_str) < 0) {
-                    ERR("%s: memory allocation failed (%s) - %s:%d",
-                        __func__, strerror(errno), __FILE__, __LINE__);
+                *rel = op_arena_printf(arena, format, path, attr_iter->value_str);
+                if (!*rel) {
                     return -1;
                 }
             }
@@ -121,6 +121,95 @@ edit_get_move(struct lyd_node *node, const char *path, sr_move_position_t *pos,
     return 0;
 }
 
+/* nested operation and insert attributes must be processed node by node */
+static int
+edit_replace_diffable(struct lyd_node *node)
+{
+    struct lyd_node *next, *elem;
+
+    if (!(node->schema->nodetype & (LYS_CONTAINER | LYS_LIST))) {
+        return 0;
+    }
+
+    LY_TREE_DFS_BEGIN(node, next, elem) {
+        if ((elem != node) && elem->attr) {
+            return 0;
+        }
+        LY_TREE_DFS_END(node, next, elem);
+    }
+
+    return 1;
+}
+
+/*
+ * replace the node by applying only its differences from the current data,
+ * returns 1 if the node cannot be compared and must be recreated as a whole
+ */
+static int
+edit_replace_diff(sr_session_ctx_t *srs, struct lyd_node *node, const char *path, struct op_arena *arena,
+                  struct nc_server_reply **ereply)
+{
+    struct lyd_node *current = NULL;
+    struct lyd_difflist *diff;
+    struct ly_set *set;
+    char *xpath;
+    int ret;
+
+    if (!edit_replace_diffable(node)) {
+        return 1;
+    }
+
+    xpath = op_arena_printf(arena, "%s//.", path);
+    if (!xpath) {
+        return -1;
+    }
+    ret = op_tree_builder_fetch(srs, &current, xpath, NULL);
+    if (ret || !current) {
+        /* failed read is reported by the recreation, no data means only creating */
+        lyd_free_withsiblings(current);
+        return 1;
+    }
+
+    set = lyd_find_path(current, path);
+    if (!set || (set->number != 1)) {
+        ly_set_free(set);
+        lyd_free_withsiblings(current);
+        return 1;
+    }
+    diff = lyd_diff(set->set.d[0], node, LYD_DIFFOPT_NOSIBLINGS);
+    ly_set_free(set);
+    if (!diff) {
+        lyd_free_withsiblings(current);
+        return 1;
+    }
+
+    ret = op_diff_apply(srs, diff, ereply);
+    lyd_free_diff(diff);
+    lyd_free_withsiblings(current);
+    return ret;
+}
+
+/*
+ * revert the changes of this edit, if the candidate has other changes of the session
+ * they are kept by restoring only the data saved in the undo log
+ */
+static void
+edit_rollback(struct np2_sessions *sessions, struct op_undo *undo, int undo_log)
+{
+    if (undo_log) {
+        if (!op_undo_restore(undo, sessions->srs)) {
+            DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: %u change(s) reverted.", undo->count);
+            return;
+        }
+        VRB("Restoring the candidate after a failed edit-config failed, discarding all its changes.");
+    }
+
+    np2srv_sr_discard_changes(sessions->srs, NULL);
+    if (sessions->ds == SR_DS_CANDIDATE) {
+        op_cand_clear(sessions);
+    }
+}
+
 static const char *
 defop2str(enum NP2_EDIT_DEFOP defop)
 {
@@ -161,217 +250,83 @@ op2str(enum NP2_EDIT_OP op)
     return "none";
 }
 
-struct nc_server_reply *
-op_editconfig(struct lyd_node *rpc, struct nc_session *ncs)
+/*
+ * apply the edit into the session, errors of the changes are added into ereply and processed
+ * according to the error-option, returns -1 only on a fatal error
+ */
+static int
+edit_apply(sr_session_ctx_t *srs, struct lyd_node *config, enum NP2_EDIT_DEFOP defop, enum NP2_EDIT_ERROPT erropt,
+           struct op_undo *undo, int undo_log, struct op_arena *arena, struct nc_server_reply **ereply)
 {
-    struct nc_server_error *e = NULL;
-    struct nc_server_reply *ereply = NULL;
-    struct np2_sessions *sessions = NULL;
-    sr_datastore_t ds = 0;
     sr_move_position_t pos = SR_MOVE_LAST;
     sr_val_t value;
-    struct ly_set *nodeset;
-    /* default value for default-operation is "merge" */
-    enum NP2_EDIT_DEFOP defop = NP2_EDIT_DEFOP_MERGE;
-    /* default value for test-option is "test-then-set" */
-    enum NP2_EDIT_TESTOPT testopt = NP2_EDIT_TESTOPT_TESTANDSET;
-    /* default value for error-option is "stop-on-error" */
-    enum NP2_EDIT_ERROPT erropt = NP2_EDIT_ERROPT_STOP;
-    struct lyd_node *config = NULL, *next, *iter;
-    char *str, *path, *rel, *valbuf, quot;
-    const char *cstr;
-    enum NP2_EDIT_OP *op = NULL, *op_new;
-    uint16_t *path_levels = NULL, *path_levels_new;
+    struct lyd_node *next, *iter;
+    char *path, *rel, *valbuf, quot;
+    enum NP2_EDIT_OP *op = NULL;
+    uint16_t *path_levels = NULL;
     uint16_t path_levels_index, path_levels_size = 0;
-    int op_index, op_size, path_index = 0, missing_keys = 0, lastkey = 0, np_cont;
+    int op_index, op_size, path_index = 0, missing_keys = 0, lastkey = 0, np_cont, diffed;
     int ret, path_len, new_len;
-    struct lyd_node_anydata *any;
+    struct op_arena_mark mark;
 
-    /* get sysrepo connections for this session */
-    sessions = (struct np2_sessions *)nc_session_get_data(ncs);
-
-    if (np2srv_sr_check_exec_permission(sessions->srs, "/ietf-netconf:edit-config", &ereply)) {
-        goto cleanup;
-    }
-
-    /* init */
     path_len = 128;
-    path = malloc(path_len);
+    path = op_arena_alloc(arena, path_len);
     if (!path) {
-        EMEM;
-        goto internalerror;
+        return -1;
     }
     path[path_index] = '\0';
 
-    /*
-     * parse parameters
-     */
-
-    /* target */
-    nodeset = lyd_find_path(rpc, "/ietf-netconf:edit-config/target/*");
-    cstr = nodeset->set.d[0]->schema->name;
-    ly_set_free(nodeset);
-
-    if (!strcmp(cstr, "running")) {
-        ds = SR_DS_RUNNING;
-    } else if (!strcmp(cstr, "candidate")) {
-        ds = SR_DS_CANDIDATE;
-    }
-    /* edit-config on startup is not allowed by RFC 6241 */
-    if (ds != sessions->ds) {
-        /* update sysrepo session */
-        if (np2srv_sr_session_switch_ds(sessions->srs, ds, &ereply)) {
-            goto cleanup;
-        }
-        sessions->ds = ds;
+    valbuf = NULL;
+    path_levels_size = op_size = 16;
+    op = op_arena_alloc(arena, op_size * sizeof *op);
+    path_levels = op_arena_alloc(arena, path_levels_size * sizeof *path_levels);
+    if (!op || !path_levels) {
+        return -1;
     }
+    op[0] = NP2_EDIT_NONE;
+    op_index = 0;
+    path_levels_index = 0;
+    mark = op_arena_mark(arena);
+    LY_TREE_DFS_BEGIN(config, next, iter) {
+        /* values and relative paths of the previous node are not needed anymore */
+        op_arena_release(arena, mark);
 
-    /* default-operation */
-    nodeset = lyd_find_path(rpc, "/ietf-netconf:edit-config/default-operation");
-    if (nodeset->number) {
-        cstr = ((struct lyd_node_leaf_list*)nodeset->set.d[0])->value_str;
-        if (!strcmp(cstr, "replace")) {
-            defop = NP2_EDIT_DEFOP_REPLACE;
-        } else if (!strcmp(cstr, "none")) {
-            defop = NP2_EDIT_DEFOP_NONE;
-        } else if (!strcmp(cstr, "merge")) {
-            defop = NP2_EDIT_DEFOP_MERGE;
+        /* make room for this node in the stacks and in the path (name with prefix and a predicate with value) */
+        if (op_index + 1 == op_size) {
+            op = op_arena_grow(arena, op, op_size * sizeof *op, op_size * 2 * sizeof *op);
+            op_size *= 2;
         }
-    }
-    ly_set_free(nodeset);
-
-    /* test-option */
-    nodeset = lyd_find_path(rpc, "/ietf-netconf:edit-config/test-option");
-    if (nodeset->number) {
-        cstr = ((struct lyd_node_leaf_list*)nodeset->set.d[0])->value_str;
-        if (!strcmp(cstr, "set")) {
-            testopt = NP2_EDIT_TESTOPT_SET;
-        } else if (!strcmp(cstr, "test-only")) {
-            testopt = NP2_EDIT_TESTOPT_TEST;
-        } else if (!strcmp(cstr, "test-then-set")) {
-            testopt = NP2_EDIT_TESTOPT_TESTANDSET;
+        if (path_levels_index == path_levels_size) {
+            path_levels = op_arena_grow(arena, path_levels, path_levels_size * sizeof *path_levels,
+                                        path_levels_size * 2 * sizeof *path_levels);
+            path_levels_size *= 2;
         }
-    }
-    ly_set_free(nodeset);
-
-    /* error-option */
-    nodeset = lyd_find_path(rpc, "/ietf-netconf:edit-config/error-option");
-    if (nodeset->number) {
-        cstr = ((struct lyd_node_leaf_list*)nodeset->set.d[0])->value_str;
-        if (!strcmp(cstr, "rollback-on-error")) {
-            erropt = NP2_EDIT_ERROPT_ROLLBACK;
-        } else if (!strcmp(cstr, "continue-on-error")) {
-            erropt = NP2_EDIT_ERROPT_CONT;
-        } else if (!strcmp(cstr, "stop-on-error")) {
-            erropt = NP2_EDIT_ERROPT_STOP;
+        new_len = path_index + strlen(lyd_node_module(iter)->name) + 2 * strlen(iter->schema->name) + 10;
+        if (iter->schema->nodetype & (LYS_LEAF | LYS_LEAFLIST)) {
+            new_len += strlen(((struct lyd_node_leaf_list *)iter)->value_str);
         }
-    }
-    ly_set_free(nodeset);
-
-
-    /* config */
-    nodeset = lyd_find_path(rpc, "/ietf-netconf:edit-config/config");
-    if (nodeset->number) {
-        any = (struct lyd_node_anydata *)nodeset->set.d[0];
-        switch (any->value_type) {
-        case LYD_ANYDATA_CONSTSTRING:
-        case LYD_ANYDATA_STRING:
-        case LYD_ANYDATA_SXML:
-            config = lyd_parse_mem(np2srv.ly_ctx, any->value.str, LYD_XML, LYD_OPT_EDIT | LYD_OPT_STRICT);
-            break;
-        case LYD_ANYDATA_DATATREE:
-            config = any->value.tree;
-            any->value.tree = NULL; /* "unlink" data tree from anydata to have full control */
-            break;
-        case LYD_ANYDATA_XML:
-            config = lyd_parse_xml(np2srv.ly_ctx, &any->value.xml, LYD_OPT_EDIT | LYD_OPT_STRICT);
-            break;
-        case LYD_ANYDATA_JSON:
-        case LYD_ANYDATA_JSOND:
-        case LYD_ANYDATA_SXMLD:
-            EINT;
-            break;
+        if (new_len > path_len) {
+            new_len = (new_len > 2 * path_len) ? new_len : 2 * path_len;
+            path = op_arena_grow(arena, path, path_len, new_len);
+            path_len = new_len;
         }
-        ly_set_free(nodeset);
-        if (ly_errno) {
-            ereply = nc_server_reply_err(nc_err_libyang());
-            goto cleanup;
-        } else if (!config) {
-            /* nothing to do */
-            ereply = nc_server_reply_ok();
-            goto cleanup;
+        if (!op || !path_levels || !path) {
+            return -1;
         }
-    } else {
-        /* TODO support for :url capability */
-        ly_set_free(nodeset);
-        EINT;
-        goto internalerror;
-    }
-
-    lyd_print_mem(&str, config, LYD_XML, LYP_WITHSIBLINGS | LYP_FORMAT);
-    DBG("EDIT_CONFIG: ds %d, defop %s, testopt %d, config:\n%s", sessions->srs, defop2str(defop), testopt, str);
-    free(str);
-    str = NULL;
-
-    if (sessions->ds != SR_DS_CANDIDATE) {
-        /* update data from sysrepo */
-        if (np2srv_sr_session_refresh(sessions->srs, &ereply)) {
-            goto cleanup;
-        }
-    }
-
-    /*
-     * data manipulation
-     */
-    valbuf = NULL;
-    path_levels_size = op_size = 16;
-    op = malloc(op_size * sizeof *op);
-    op[0] = NP2_EDIT_NONE;
-    op_index = 0;
-    path_levels = malloc(path_levels_size * sizeof *path_levels);
-    path_levels_index = 0;
-    LY_TREE_DFS_BEGIN(config, next, iter) {
+        mark = op_arena_mark(arena);
 
         /* maintain list of operations */
         if (!missing_keys) {
             op_index++;
-            if (op_index == op_size) {
-                op_size += 16;
-                op_new = realloc(op, op_size * sizeof *op);
-                if (!op_new) {
-                    EMEM;
-                    goto internalerror;
-                }
-                op = op_new;
-            }
             op[op_index] = edit_get_op(iter, op[op_index - 1], defop);
 
             /* maintain path */
-            if (path_levels_index == path_levels_size) {
-                path_levels_size += 16;
-                path_levels_new = realloc(path_levels, path_levels_size * sizeof *path_levels);
-                if (!path_levels_new) {
-                    EMEM;
-                    goto internalerror;
-                }
-                path_levels = path_levels_new;
-            }
             path_levels[path_levels_index++] = path_index;
             if (!iter->parent || lyd_node_module(iter) != lyd_node_module(iter->parent)) {
                 /* with prefix */
-                new_len = path_index + 1 + strlen(lyd_node_module(iter)->name) + 1 + strlen(iter->schema->name) + 1;
-                if (new_len > path_len) {
-                    path_len = new_len;
-                    path = realloc(path, new_len);
-                }
                 path_index += sprintf(&path[path_index], "/%s:%s", lyd_node_module(iter)->name, iter->schema->name);
             } else {
                 /* without prefix */
-                new_len = path_index + 1 + strlen(iter->schema->name) + 1;
-                if (new_len > path_len) {
-                    path_len = new_len;
-                    path = realloc(path, new_len);
-                }
                 path_index += sprintf(&path[path_index], "/%s", iter->schema->name);
             }
 
@@ -384,6 +339,7 @@ op_editconfig(struct lyd_node *rpc, struct nc_session *ncs)
         rel = NULL;
         lastkey = 0;
         np_cont = 0;
+        diffed = 0;
         switch (iter->schema->nodetype) {
         case LYS_CONTAINER:
             if (!((struct lys_node_container *)iter->schema)->presence) {
@@ -395,20 +351,14 @@ op_editconfig(struct lyd_node *rpc, struct nc_session *ncs)
             }
 
 
-            DBG("EDIT_CONFIG: %s container %s, operation %s", (!np_cont ? "presence" : ""), path, op2str(op[op_index]));
+            DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: %s container %s, operation %s",
+                    (!np_cont ? "presence" : ""), path, op2str(op[op_index]));
             break;
         case LYS_LEAF:
             if (missing_keys) {
                 /* still processing list keys */
                 missing_keys--;
                 /* add key predicate into the list's path */
-                new_len = path_index + 1 + strlen(iter->schema->name) + 2
-                          + strlen(((struct lyd_node_leaf_list *)iter)->value_str) + 3;
-                if (new_len > path_len) {
-                    path_len = new_len;
-                    path = realloc(path, new_len);
-                }
-
                 if (strchr(((struct lyd_node_leaf_list *)iter)->value_str, '\'')) {
                     quot = '\"';
                 } else {
@@ -420,32 +370,28 @@ op_editconfig(struct lyd_node *rpc, struct nc_session *ncs)
                     /* the last key, create the list instance */
                     lastkey = 1;
 
-                    DBG("EDIT_CONFIG: list %s, operation %s", path, op2str(op[op_index]));
+                    DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: list %s, operation %s", path, op2str(op[op_index]));
                     break;
                 }
                 goto dfs_continue;
             }
 
             /* regular leaf */
-            DBG("EDIT_CONFIG: leaf %s, operation %s", path, op2str(op[op_index]));
+            DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: leaf %s, operation %s", path, op2str(op[op_index]));
             break;
         case LYS_LEAFLIST:
             /* get info about inserting to a specific place */
-            if (edit_get_move(iter, path, &pos, &rel)) {
-                goto internalerror;
+            if (edit_get_move(iter, path, &pos, &rel, arena)) {
+                return -1;
             }
 
-            DBG("EDIT_CONFIG: leaflist %s, operation %s", path, op2str(op[op_index]));
+            DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: leaflist %s, operation %s", path, op2str(op[op_index]));
             if (pos != SR_MOVE_LAST) {
-                DBG("EDIT_CONFIG: moving leaflist %s, position %d (%s)", path, pos, rel ? rel : "absolute");
+                DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: moving leaflist %s, position %d (%s)",
+                        path, pos, rel ? rel : "absolute");
             }
 
             /* in leaf-list, the value is also the key, so add it into the path */
-            new_len = path_index + 4 + strlen(((struct lyd_node_leaf_list *)iter)->value_str) + 3;
-            if (new_len > path_len) {
-                path_len = new_len;
-                path = realloc(path, new_len);
-            }
             if (strchr(((struct lyd_node_leaf_list *)iter)->value_str, '\'')) {
                 quot = '\"';
             } else {
@@ -456,13 +402,13 @@ op_editconfig(struct lyd_node *rpc, struct nc_session *ncs)
             break;
         case LYS_LIST:
             /* get info about inserting to a specific place */
-            if (edit_get_move(iter, path, &pos, &rel)) {
-                goto internalerror;
+            if (edit_get_move(iter, path, &pos, &rel, arena)) {
+                return -1;
             }
 
             if (op[op_index] < NP2_EDIT_DELETE) {
                 /* set value for sysrepo, it will be used as soon as all the keys are processed */
-                op_set_srval(iter, NULL, 0, &value, &valbuf);
+                op_set_srval(iter, NULL, 0, &value, &valbuf, arena);
             }
 
             /* the creation must be finished later when we get know keys */
@@ -474,12 +420,18 @@ op_editconfig(struct lyd_node *rpc, struct nc_session *ncs)
             break;
         default:
             ERR("%s: Invalid node to process", __func__);
-            goto internalerror;
+            return -1;
         }
 
         if ((op[op_index] < NP2_EDIT_DELETE) && !lastkey) {
             /* set value for sysrepo */
-            op_set_srval(iter, NULL, 0, &value, &valbuf);
+            op_set_srval(iter, NULL, 0, &value, &valbuf, arena);
+        }
+
+        /* save the node before its change, the whole subtree if it is removed or replaced */
+        if (undo_log && (op[op_index] > NP2_EDIT_NONE) && ((op[op_index] != NP2_EDIT_MERGE) || !np_cont)
+                && op_undo_save(undo, srs, path, op[op_index] >= NP2_EDIT_REPLACE)) {
+            return -1;
         }
 
         /* apply change to sysrepo */
@@ -487,68 +439,76 @@ op_editconfig(struct lyd_node *rpc, struct nc_session *ncs)
         case NP2_EDIT_MERGE:
             /* create the node */
             if (!np_cont) {
-                ret = np2srv_sr_set_item(sessions->srs, path, &value, 0, &ereply);
+                ret = np2srv_sr_set_item(srs, path, &value, 0, ereply);
             }
             break;
         case NP2_EDIT_REPLACE_INNER:
         case NP2_EDIT_CREATE:
             /* create the node, but it must not exists */
-            ret = np2srv_sr_set_item(sessions->srs, path, &value, SR_EDIT_STRICT, &ereply);
+            ret = np2srv_sr_set_item(srs, path, &value, SR_EDIT_STRICT, ereply);
             break;
         case NP2_EDIT_DELETE:
             /* remove the node, but it must exists */
-            ret = np2srv_sr_delete_item(sessions->srs, path, SR_EDIT_STRICT, &ereply);
+            ret = np2srv_sr_delete_item(srs, path, SR_EDIT_STRICT, ereply);
             break;
         case NP2_EDIT_REMOVE:
             /* remove the node */
-            ret = np2srv_sr_delete_item(sessions->srs, path, 0, &ereply);
+            ret = np2srv_sr_delete_item(srs, path, 0, ereply);
             break;
         case NP2_EDIT_REPLACE:
+            /* change only what differs from the current data, children are then already processed */
+            ret = edit_replace_diff(srs, lastkey ? iter->parent : iter, path, arena, ereply);
+            if (ret != 1) {
+                diffed = 1;
+                break;
+            }
+
             /* remove the node first */
-            ret = np2srv_sr_delete_item(sessions->srs, path, 0, &ereply);
+            ret = np2srv_sr_delete_item(srs, path, 0, ereply);
             /* create it again (but we removed all the children, sysrepo forbids creating NP containers as it's redundant) */
             if (!ret && !np_cont) {
-                ret = np2srv_sr_set_item(sessions->srs, path, &value, 0, &ereply);
+                ret = np2srv_sr_set_item(srs, path, &value, 0, ereply);
             }
             break;
         default:
             /* do nothing */
             break;
         }
-        if (valbuf) {
-            free(valbuf);
-            valbuf = NULL;
-        }
 
 resultcheck:
         /* check the result */
         if (!ret) {
-            DBG("EDIT_CONFIG: success (%s).", path);
+            DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: success (%s).", path);
         } else {
             switch (erropt) {
             case NP2_EDIT_ERROPT_CONT:
-                DBG("EDIT_CONFIG: continue-on-error (%s).", nc_err_get_msg(nc_server_reply_get_last_err(ereply)));
+                DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: continue-on-error (%s).",
+                        nc_err_get_msg(nc_server_reply_get_last_err(*ereply)));
                 goto dfs_nextsibling;
             case NP2_EDIT_ERROPT_ROLLBACK:
-                DBG("EDIT_CONFIG: rollback-on-error (%s).", nc_err_get_msg(nc_server_reply_get_last_err(ereply)));
-                goto cleanup;
+                DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: rollback-on-error (%s).",
+                        nc_err_get_msg(nc_server_reply_get_last_err(*ereply)));
+                return 0;
             case NP2_EDIT_ERROPT_STOP:
-                DBG("EDIT_CONFIG: stop-on-error (%s).", nc_err_get_msg(nc_server_reply_get_last_err(ereply)));
-                goto cleanup;
+                DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: stop-on-error (%s).",
+                        nc_err_get_msg(nc_server_reply_get_last_err(*ereply)));
+                return 0;
             }
         }
 
         /* move user-ordered list/leaflist */
         if (pos != SR_MOVE_LAST) {
-            ret = np2srv_sr_move_item(sessions->srs, path, pos, rel, &ereply);
-            free(rel);
+            if (undo_log && op_undo_save_position(undo, srs, path)) {
+                return -1;
+            }
+            ret = np2srv_sr_move_item(srs, path, pos, rel, ereply);
             pos = SR_MOVE_LAST;
             goto resultcheck;
         }
 
-        if ((op[op_index] == NP2_EDIT_DELETE) || (op[op_index] == NP2_EDIT_REMOVE)
+        if ((op[op_index] == NP2_EDIT_DELETE) || (op[op_index] == NP2_EDIT_REMOVE) || diffed
                 || ((op[op_index] == NP2_EDIT_CREATE) && (ret == SR_ERR_DATA_EXISTS))) {
-            /* when delete, remove subtree, or failed create
+            /* when delete, remove subtree, replaced by diff, or failed create
              * no need to go into children */
             if (lastkey) {
                 /* we were processing list's keys */
@@ -605,67 +565,590 @@ dfs_parent:
         /* end of modified LY_TREE_DFS_END */
     }
 
+    return 0;
+}
+
+static void
+edit_err_internal(struct nc_server_reply **ereply)
+{
+    struct nc_server_error *e;
+
+    e = nc_err(NC_ERR_OP_FAILED, NC_ERR_TYPE_APP);
+    nc_err_set_msg(e, np2log_lasterr(), "en");
+    if (*ereply) {
+        nc_server_reply_add_err(*ereply, e);
+    } else {
+        *ereply = nc_server_reply_err(e);
+    }
+}
+
+/* edit of running waiting to be committed with other edits */
+struct edit_group_req {
+    sr_session_ctx_t *srs;            /* session of the request */
+    struct lyd_node *config;
+    enum NP2_EDIT_DEFOP defop;
+    enum NP2_EDIT_ERROPT erropt;
+    struct nc_server_reply *ereply;
+    char **paths;                     /* edited subtrees */
+    uint32_t path_count;
+    int applied;                      /* changes are in the leader session */
+    int done;
+    struct edit_group_req *next;
+};
+
+struct edit_group_batch {
+    const char *user;
+    struct edit_group_req *first;
+    struct edit_group_req *last;
+    uint32_t count;                   /* edits in the batch, including the leader */
+};
+
+/* largest batch, a full batch is committed right away */
+#define EDIT_GROUP_MAX 64
+
+/* group commit, the first edit waits for the others, applies them all in its session and commits once */
+static struct {
+    uint32_t delay;                   /* ms, 0 means disabled */
+    struct edit_group_batch *open;    /* batch still accepting edits */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} edit_group = {0, NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+void
+op_editconfig_group_configure(uint32_t delay)
+{
+    pthread_mutex_lock(&edit_group.lock);
+    edit_group.delay = delay;
+    pthread_mutex_unlock(&edit_group.lock);
+}
+
+/* add the paths of the subtrees edited in the node, the deepest nodes edited explicitly */
+static int
+edit_group_add_paths(struct edit_group_req *req, struct lyd_node *node)
+{
+    struct lyd_node *child;
+    struct lyd_attr *attr;
+    char *path = NULL, **paths;
+    int inner = 0;
+
+    for (attr = node->attr; attr; attr = attr->next) {
+        if (!strcmp(attr->annotation->module->name, "yang") && !strcmp(attr->name, "insert")) {
+            /* the positions of all the instances change */
+            if (node->parent) {
+                path = lyd_path(node->parent);
+            } else if (asprintf(&path, "/%s:%s", lyd_node_module(node)->name, node->schema->name) == -1) {
+                path = NULL;
+            }
+            goto add;
+        }
+        if (!strcmp(attr->annotation->module->name, "ietf-netconf") && !strcmp(attr->name, "operation")
+                && strcmp(attr->value_str, "merge")) {
+            /* the whole subtree is created, replaced, or removed */
+            goto add_node;
+        }
+    }
+    if (!node->parent && (req->defop == NP2_EDIT_DEFOP_REPLACE)) {
+        goto add_node;
+    }
+
+    if (!(node->schema->nodetype & (LYS_LEAF | LYS_LEAFLIST | LYS_ANYDATA))) {
+        LY_TREE_FOR(node->child, child) {
+            if ((child->schema->nodetype == LYS_LEAF) && lys_is_key((struct lys_node_leaf *)child->schema, NULL)) {
+                continue;
+            }
+            inner = 1;
+            if (edit_group_add_paths(req, child)) {
+                return -1;
+            }
+        }
+        if (inner) {
+            return 0;
+        }
+    }
+
+add_node:
+    path = lyd_path(node);
+add:
+    if (!path) {
+        EMEM;
+        return -1;
+    }
+    paths = realloc(req->paths, (req->path_count + 1) * sizeof *paths);
+    if (!paths) {
+        EMEM;
+        free(path);
+        return -1;
+    }
+    req->paths = paths;
+    req->paths[req->path_count++] = path;
+    return 0;
+}
+
+static void
+edit_group_free_paths(struct edit_group_req *req)
+{
+    uint32_t i;
+
+    for (i = 0; i < req->path_count; ++i) {
+        free(req->paths[i]);
+    }
+    free(req->paths);
+    req->paths = NULL;
+    req->path_count = 0;
+}
+
+/* one path is the other one or its ancestor */
+static int
+edit_group_paths_overlap(const char *path1, const char *path2)
+{
+    size_t len1 = strlen(path1), len2 = strlen(path2);
+
+    if (len1 > len2) {
+        return edit_group_paths_overlap(path2, path1);
+    }
+    return !strncmp(path1, path2, len1) && (!path2[len1] || (path2[len1] == '/') || (path2[len1] == '['));
+}
+
+/* grouped edits must not change the same subtrees, so that they do not depend on each other */
+static int
+edit_group_disjoint(struct edit_group_batch *batch, struct edit_group_req *new_req)
+{
+    struct edit_group_req *req;
+    uint32_t i, j;
+
+    for (req = batch->first; req; req = req->next) {
+        for (i = 0; i < req->path_count; ++i) {
+            for (j = 0; j < new_req->path_count; ++j) {
+                if (edit_group_paths_overlap(req->paths[i], new_req->paths[j])) {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+static void
+edit_group_alone(struct edit_group_req *req, struct op_arena *arena)
+{
+    if (np2srv_sr_session_refresh(req->srs, &req->ereply)) {
+        return;
+    }
+    if (edit_apply(req->srs, req->config, req->defop, req->erropt, NULL, 0, arena, &req->ereply)) {
+        edit_err_internal(&req->ereply);
+        np2srv_sr_discard_changes(req->srs, NULL);
+    } else if ((req->erropt == NP2_EDIT_ERROPT_ROLLBACK) && req->ereply) {
+        np2srv_sr_discard_changes(req->srs, NULL);
+    } else if (np2srv_sr_commit(req->srs, &req->ereply)) {
+        np2srv_sr_discard_changes(req->srs, NULL);
+    }
+}
+
+static void
+edit_group_process(sr_session_ctx_t *srs, struct edit_group_batch *batch, struct op_arena *arena)
+{
+    struct edit_group_req *req;
+    struct op_arena_mark mark;
+    struct op_undo undo;
+    uint32_t count = 0;
+    int ret;
+
+    mark = op_arena_mark(arena);
+    for (req = batch->first; req; req = req->next) {
+        memset(&undo, 0, sizeof undo);
+        ret = edit_apply(srs, req->config, req->defop, req->erropt, &undo, 1, arena, &req->ereply);
+        if (ret || ((req->erropt == NP2_EDIT_ERROPT_ROLLBACK) && req->ereply)) {
+            /* revert only the changes of this edit */
+            if (ret) {
+                edit_err_internal(&req->ereply);
+            }
+            if (op_undo_restore(&undo, srs)) {
+                op_undo_free(&undo);
+                goto fallback;
+            }
+        } else {
+            req->applied = 1;
+            ++count;
+        }
+        op_undo_free(&undo);
+        op_arena_release(arena, mark);
+    }
+
+    if (!count) {
+        np2srv_sr_discard_changes(srs, NULL);
+        return;
+    }
+    if (!np2srv_sr_commit(srs, NULL)) {
+        DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: %u edit(s) committed together.", count);
+        return;
+    }
+
+fallback:
+    /* some edit cannot be committed, every edit is committed separately to find out which */
+    VRB("Group commit of edit-config failed, committing the edits separately.");
+    np2srv_sr_discard_changes(srs, NULL);
+    for (req = batch->first; req; req = req->next) {
+        if (req->applied || !req->ereply) {
+            nc_server_reply_free(req->ereply);
+            req->ereply = NULL;
+            edit_group_alone(req, arena);
+            op_arena_release(arena, mark);
+        }
+    }
+}
+
+/*
+ * apply and commit the edit of running together with the concurrent edits of the same user,
+ * returns 1 if it is not possible and the edit must be processed alone
+ */
+static int
+edit_group_commit(sr_session_ctx_t *srs, const char *user, struct lyd_node *config, enum NP2_EDIT_DEFOP defop,
+                  enum NP2_EDIT_ERROPT erropt, struct op_arena *arena, struct nc_server_reply **ereply)
+{
+    struct edit_group_req req, *iter;
+    struct edit_group_batch batch;
+    struct lyd_node *node;
+    struct timespec ts;
+    int locked;
+
+    if (!user) {
+        return 1;
+    }
+
+    pthread_mutex_lock(&edit_group.lock);
+    if (!edit_group.delay) {
+        pthread_mutex_unlock(&edit_group.lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&edit_group.lock);
+
+    memset(&req, 0, sizeof req);
+    req.srs = srs;
+    req.config = config;
+    req.defop = defop;
+    req.erropt = erropt;
+    LY_TREE_FOR(config, node) {
+        if (edit_group_add_paths(&req, node)) {
+            edit_group_free_paths(&req);
+            return 1;
+        }
+    }
+
+    pthread_mutex_lock(&edit_group.lock);
+
+    pthread_rwlock_rdlock(&dslock_rwl);
+    locked = dslock.running ? 1 : 0;
+    pthread_rwlock_unlock(&dslock_rwl);
+    if (locked) {
+        /* the changes of the lock owner cannot be mixed with others */
+        pthread_mutex_unlock(&edit_group.lock);
+        edit_group_free_paths(&req);
+        return 1;
+    }
+
+    if (edit_group.open) {
+        if ((edit_group.open->count == EDIT_GROUP_MAX) || strcmp(edit_group.open->user, user)
+                || !edit_group_disjoint(edit_group.open, &req)) {
+            pthread_mutex_unlock(&edit_group.lock);
+            edit_group_free_paths(&req);
+            return 1;
+        }
+
+        /* join the batch, its leader processes the edit */
+        edit_group.open->last->next = &req;
+        edit_group.open->last = &req;
+        ++edit_group.open->count;
+        /* the leader may not need to wait anymore */
+        pthread_cond_broadcast(&edit_group.cond);
+        while (!req.done) {
+            pthread_cond_wait(&edit_group.cond, &edit_group.lock);
+        }
+        pthread_mutex_unlock(&edit_group.lock);
+
+        edit_group_free_paths(&req);
+        *ereply = req.ereply;
+        return 0;
+    }
+
+    /* lead a new batch, wait for the others */
+    batch.user = user;
+    batch.first = batch.last = &req;
+    batch.count = 1;
+    edit_group.open = &batch;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += edit_group.delay / 1000;
+    ts.tv_nsec += (edit_group.delay % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ++ts.tv_sec;
+        ts.tv_nsec -= 1000000000L;
+    }
+    /* the delay is only the maximum, no more edits can join once all the other workers are in the batch */
+    while ((batch.count < EDIT_GROUP_MAX) && (batch.count < NP2SRV_THREAD_COUNT)) {
+        if (pthread_cond_timedwait(&edit_group.cond, &edit_group.lock, &ts) == ETIMEDOUT) {
+            break;
+        }
+    }
+    edit_group.open = NULL;
+    pthread_mutex_unlock(&edit_group.lock);
+
+    if (batch.first == batch.last) {
+        /* nobody joined */
+        edit_group_free_paths(&req);
+        return 1;
+    }
+    edit_group_process(srs, &batch, arena);
+
+    pthread_mutex_lock(&edit_group.lock);
+    for (iter = batch.first; iter; iter = iter->next) {
+        iter->done = 1;
+    }
+    pthread_cond_broadcast(&edit_group.cond);
+    pthread_mutex_unlock(&edit_group.lock);
+
+    edit_group_free_paths(&req);
+    *ereply = req.ereply;
+    return 0;
+}
+
+struct nc_server_reply *
+op_editconfig(struct lyd_node *rpc, struct nc_session *ncs)
+{
+    struct nc_server_reply *ereply = NULL;
+    struct np2_sessions *sessions = NULL;
+    sr_datastore_t ds = 0;
+    /* default value for default-operation is "merge" */
+    enum NP2_EDIT_DEFOP defop = NP2_EDIT_DEFOP_MERGE;
+    /* default value for test-option is "test-then-set" */
+    enum NP2_EDIT_TESTOPT testopt = NP2_EDIT_TESTOPT_TESTANDSET;
+    /* default value for error-option is "stop-on-error" */
+    enum NP2_EDIT_ERROPT erropt = NP2_EDIT_ERROPT_STOP;
+    struct lyd_node *config = NULL, *param, *iter;
+    char *str;
+    const char *cstr;
+    struct lyd_node_anydata *any;
+    struct op_arena *arena = NULL;
+    struct op_undo undo = {NULL, 0};
+    int undo_log = 0;
+
+    /* get sysrepo connections for this session */
+    sessions = (struct np2_sessions *)nc_session_get_data(ncs);
+
+    if (np2srv_sr_check_exec_permission(sessions->srs, "/ietf-netconf:edit-config", &ereply)) {
+        goto cleanup;
+    }
+
+    /* init, all the traversal data are allocated from the arena */
+    arena = op_arena_get();
+    if (!arena) {
+        goto internalerror;
+    }
+
+    /*
+     * parse parameters
+     */
+
+    /* target */
+    cstr = op_param_get(rpc, OP_PARAM_EDIT_TARGET)->child->schema->name;
+
+    if (!strcmp(cstr, "running")) {
+        ds = SR_DS_RUNNING;
+    } else if (!strcmp(cstr, "candidate")) {
+        ds = SR_DS_CANDIDATE;
+    }
+    /* edit-config on startup is not allowed by RFC 6241 */
+    if (ds != sessions->ds) {
+        /* update sysrepo session */
+        if (np2srv_sr_session_switch_ds(sessions->srs, ds, &ereply)) {
+            goto cleanup;
+        }
+        sessions->ds = ds;
+    }
+    if (op_sessions_config_only(sessions, &ereply)) {
+        goto cleanup;
+    }
+
+    /* default-operation */
+    param = op_param_get(rpc, OP_PARAM_EDIT_DEFOP);
+    if (param) {
+        cstr = ((struct lyd_node_leaf_list *)param)->value_str;
+        if (!strcmp(cstr, "replace")) {
+            defop = NP2_EDIT_DEFOP_REPLACE;
+        } else if (!strcmp(cstr, "none")) {
+            defop = NP2_EDIT_DEFOP_NONE;
+        } else if (!strcmp(cstr, "merge")) {
+            defop = NP2_EDIT_DEFOP_MERGE;
+        }
+    }
+
+    /* test-option */
+    param = op_param_get(rpc, OP_PARAM_EDIT_TESTOPT);
+    if (param) {
+        cstr = ((struct lyd_node_leaf_list *)param)->value_str;
+        if (!strcmp(cstr, "set")) {
+            testopt = NP2_EDIT_TESTOPT_SET;
+        } else if (!strcmp(cstr, "test-only")) {
+            testopt = NP2_EDIT_TESTOPT_TEST;
+        } else if (!strcmp(cstr, "test-then-set")) {
+            testopt = NP2_EDIT_TESTOPT_TESTANDSET;
+        }
+    }
+
+    /* error-option */
+    param = op_param_get(rpc, OP_PARAM_EDIT_ERROPT);
+    if (param) {
+        cstr = ((struct lyd_node_leaf_list *)param)->value_str;
+        if (!strcmp(cstr, "rollback-on-error")) {
+            erropt = NP2_EDIT_ERROPT_ROLLBACK;
+        } else if (!strcmp(cstr, "continue-on-error")) {
+            erropt = NP2_EDIT_ERROPT_CONT;
+        } else if (!strcmp(cstr, "stop-on-error")) {
+            erropt = NP2_EDIT_ERROPT_STOP;
+        }
+    }
+
+
+    /* config */
+    param = op_param_get(rpc, OP_PARAM_EDIT_CONFIG);
+    if (param) {
+        any = (struct lyd_node_anydata *)param;
+        switch (any->value_type) {
+        case LYD_ANYDATA_CONSTSTRING:
+        case LYD_ANYDATA_STRING:
+        case LYD_ANYDATA_SXML:
+            config = lyd_parse_mem(np2srv.ly_ctx, any->value.str, LYD_XML, LYD_OPT_EDIT | LYD_OPT_STRICT);
+            break;
+        case LYD_ANYDATA_DATATREE:
+            config = any->value.tree;
+            any->value.tree = NULL; /* "unlink" data tree from anydata to have full control */
+            break;
+        case LYD_ANYDATA_XML:
+            /* the XML tree received by libnetconf2 is freed as it is being parsed, it is never needed again */
+            config = lyd_parse_xml(np2srv.ly_ctx, &any->value.xml, LYD_OPT_EDIT | LYD_OPT_DESTRUCT | LYD_OPT_STRICT);
+            break;
+        case LYD_ANYDATA_JSON:
+        case LYD_ANYDATA_JSOND:
+        case LYD_ANYDATA_SXMLD:
+            EINT;
+            break;
+        }
+        if (ly_errno) {
+            ereply = nc_server_reply_err(nc_err_libyang());
+            goto cleanup;
+        } else if (!config) {
+            /* nothing to do */
+            ereply = nc_server_reply_ok();
+            goto cleanup;
+        }
+    } else {
+        /* TODO support for :url capability */
+        EINT;
+        goto internalerror;
+    }
+
+    if (DBG_ON(NP2_DBG_EDIT_CONFIG)) {
+        /* printing the whole content is too expensive to be done for nothing */
+        lyd_print_mem(&str, config, LYD_XML, LYP_WITHSIBLINGS | LYP_FORMAT);
+        DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: ds %d, defop %s, testopt %d, config:\n%s", sessions->ds,
+                defop2str(defop), testopt, str);
+        free(str);
+        str = NULL;
+    }
+
+    if (sessions->ds != SR_DS_CANDIDATE) {
+        /* update data from sysrepo */
+        if (np2srv_sr_session_refresh(sessions->srs, &ereply)) {
+            goto cleanup;
+        }
+    }
+
+    if ((sessions->ds == SR_DS_CANDIDATE) && (sessions->flags & NP2S_CAND_CHANGED)) {
+        /* discarding changes would also discard the previous edits of the candidate */
+        undo_log = 1;
+    }
+    if ((sessions->ds != SR_DS_CANDIDATE) && (testopt != NP2_EDIT_TESTOPT_TEST)) {
+        /* copying running into startup copies only the changed modules */
+        LY_TREE_FOR(config, iter) {
+            op_startup_mark(lyd_node_module(iter)->name);
+        }
+    }
+
+    /*
+     * data manipulation
+     */
+    if ((sessions->ds == SR_DS_RUNNING) && (testopt != NP2_EDIT_TESTOPT_TEST)
+            && !edit_group_commit(sessions->srs, nc_session_get_username(ncs), config, defop, erropt, arena, &ereply)) {
+        /* already committed */
+        op_arena_reset(arena);
+        lyd_free_withsiblings(config);
+        if (ereply) {
+            return ereply;
+        }
+        DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: success.");
+        return nc_server_reply_ok();
+    }
+    if (edit_apply(sessions->srs, config, defop, erropt, &undo, undo_log, arena, &ereply)) {
+        goto internalerror;
+    }
+
 cleanup:
     /* cleanup */
-    free(path);
-    path = NULL;
-    free(op);
-    op = NULL;
-    free(path_levels);
-    path_levels = NULL;
-    lyd_free_withsiblings(config);
-    config = NULL;
+    op_arena_reset(arena);
 
     /* just rollback and return error */
     if ((erropt == NP2_EDIT_ERROPT_ROLLBACK) && ereply) {
-        np2srv_sr_discard_changes(sessions->srs, NULL);
+        lyd_free_withsiblings(config);
+        edit_rollback(sessions, &undo, undo_log);
+        op_undo_free(&undo);
         return ereply;
     }
 
     switch (testopt) {
     case NP2_EDIT_TESTOPT_SET:
+        /*
+         * sysrepo 0.7 validates every sr_commit() and has no option to skip it, the content itself
+         * is parsed as an edit, which checks only the schema and the values, not the constraints
+         */
         VRB("edit-config test-option \"set\" not supported, validation will be performed.");
         /* fallthrough */
     case NP2_EDIT_TESTOPT_TESTANDSET:
         /* commit changes */
         if (np2srv_sr_commit(sessions->srs, &ereply)) {
-            np2srv_sr_discard_changes(sessions->srs, NULL); /* rollback the changes */
-        }
-        if (sessions->ds == SR_DS_CANDIDATE) {
-            /* mark candidate as modified */
-            sessions->flags |= NP2S_CAND_CHANGED;
+            edit_rollback(sessions, &undo, undo_log); /* rollback the changes */
+        } else if (sessions->ds == SR_DS_CANDIDATE) {
+            /* mark candidate as modified, commit copies only the changed modules */
+            LY_TREE_FOR(config, iter) {
+                op_cand_mark(sessions, lyd_node_module(iter)->name);
+            }
         }
         break;
     case NP2_EDIT_TESTOPT_TEST:
-        np2srv_sr_discard_changes(sessions->srs, NULL);
+        edit_rollback(sessions, &undo, undo_log);
         break;
     }
+    lyd_free_withsiblings(config);
+    config = NULL;
+    op_undo_free(&undo);
 
     if (ereply) {
         return ereply;
     }
 
     /* build positive RPC Reply */
-    DBG("EDIT_CONFIG: success.");
+    DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: success.");
     return nc_server_reply_ok();
 
 internalerror:
-    e = nc_err(NC_ERR_OP_FAILED, NC_ERR_TYPE_APP);
-    nc_err_set_msg(e, np2log_lasterr(), "en");
-    if (ereply) {
-        nc_server_reply_add_err(ereply, e);
-    } else {
-        ereply = nc_server_reply_err(e);
-    }
+    edit_err_internal(&ereply);
 
     /* fatal error, so continue-on-error does not apply here,
      * instead we rollback */
-    DBG("EDIT_CONFIG: fatal error, rolling back.");
-    np2srv_sr_discard_changes(sessions->srs, NULL);
+    DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: fatal error, rolling back.");
+    edit_rollback(sessions, &undo, undo_log);
+    op_undo_free(&undo);
 
-    free(path);
-    free(op);
-    free(path_levels);
+    op_arena_reset(arena);
     lyd_free_withsiblings(config);
     return ereply;
 }
@@ -154,7 +154,7 @@ op_generic(struct lyd_node *rpc, struct nc_session *ncs)
                 continue;
             }
 
-            if (op_set_srval(set->set.d[i], lyd_path(set->set.d[i]), 0, &input[in_idx], &str)) {
+            if (op_set_srval(set->set.d[i], lyd_path(set->set.d[i]), 0, &input[in_idx], &str, NULL)) {
                 e = nc_err(NC_ERR_OP_FAILED, NC_ERR_TYPE_APP);
                 nc_err_set_msg(e, np2log_lasterr(), "en");
                 ereply = nc_server_reply_err(e);
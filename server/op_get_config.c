@@ -15,11 +15,15 @@
 
 #define _GNU_SOURCE
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 
 #include <libyang/libyang.h>
 #include <nc_server.h>
@@ -29,43 +33,946 @@
 #include "operations.h"
 #include "netconf_monitoring.h"
 
-/* add whole subtree */
+/* deepest depth still translated into a fetch XPath, deeper reads are truncated after the fetch */
+#define OPGET_DEPTH_XPATH_MAX 16
+
+/* add whole subtree, or only depth levels of it (0 for unlimited) */
 static int
-opget_build_subtree_from_sysrepo(sr_session_ctx_t *srs, struct lyd_node **root, const char *subtree_xpath)
+opget_build_subtree_from_sysrepo(sr_session_ctx_t *srs, struct lyd_node **root, const char *subtree_xpath,
+                                 uint16_t depth, struct op_mem_budget *budget)
 {
-    sr_val_t *value;
-    sr_val_iter_t *sriter;
-    struct lyd_node *node;
-    char *full_subtree_xpath = NULL;
-    int rc;
+    struct lyd_node *data = NULL;
+    char *full_subtree_xpath, *ptr;
+    size_t len;
+    uint16_t i, j;
+    int ret;
+
+    if (depth && (depth <= OPGET_DEPTH_XPATH_MAX) && !strchr(subtree_xpath, '|')) {
+        /* union of the filter and its descendants up to the depth, nothing deeper is fetched */
+        len = strlen(subtree_xpath);
+        full_subtree_xpath = malloc(depth * (len + 3) + depth * (depth - 1) + 1);
+        if (!full_subtree_xpath) {
+            EMEM;
+            return -1;
+        }
+        ptr = full_subtree_xpath;
+        for (i = 0; i < depth; ++i) {
+            if (i) {
+                ptr = stpcpy(ptr, " | ");
+            }
+            ptr = stpcpy(ptr, subtree_xpath);
+            for (j = 0; j < i; ++j) {
+                ptr = stpcpy(ptr, "/*");
+            }
+        }
+
+        ret = op_tree_builder_fetch(srs, root, full_subtree_xpath, budget);
+        free(full_subtree_xpath);
+        return ret;
+    }
 
     if (asprintf(&full_subtree_xpath, "%s//.", subtree_xpath) == -1) {
         EMEM;
         return -1;
     }
 
-    rc = np2srv_sr_get_items_iter(srs, full_subtree_xpath, &sriter, NULL);
+    if (!depth) {
+        ret = op_tree_builder_fetch(srs, root, full_subtree_xpath, budget);
+        free(full_subtree_xpath);
+        return ret;
+    }
+
+    /* the filter cannot be extended, fetch the whole subtrees and truncate them, only the copy is charged */
+    ret = op_tree_builder_fetch(srs, &data, full_subtree_xpath, NULL);
     free(full_subtree_xpath);
-    if (rc == 1) {
-        /* it's ok, model without data */
+    if (!ret && data) {
+        ret = op_filter_get_tree_from_data(root, data, subtree_xpath, depth, budget);
+    }
+    lyd_free_withsiblings(data);
+    return ret;
+}
+
+/* filter selects instances of a single list (and nothing else) */
+static int
+opget_is_list_filter(const char *filter)
+{
+    const struct lys_node *snode;
+
+    if (strchr(filter, '|') || strstr(filter, "//")) {
         return 0;
-    } else if (rc) {
-        return -1;
     }
 
-    while ((!np2srv_sr_get_item_next(srs, sriter, &value, NULL))) {
-        if (op_sr_val_to_lyd_node(*root, value, &node)) {
-            sr_free_val(value);
-            sr_free_val_iter(sriter);
+    snode = ly_ctx_get_node(np2srv.ly_ctx, NULL, filter, 0);
+    if (!snode || (snode->nodetype != LYS_LIST)) {
+        return 0;
+    }
+
+    /* locally provided data are never paged */
+    if (!strncmp(filter, "/ietf-yang-library:", 19) || !strncmp(filter, "/ietf-netconf-monitoring:", 25)
+            || !strncmp(filter, "/nc-notifications:", 18)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+void
+op_get_paging_clear(struct np2_sessions *sessions)
+{
+    free(sessions->paging.cursor);
+    free(sessions->paging.xpath);
+    sr_free_val(sessions->paging.next);
+    sr_free_val_iter(sessions->paging.iter);
+    memset(&sessions->paging, 0, sizeof sessions->paging);
+}
+
+/*
+ * add one page of list instances with their subtrees, the cursor is "<position> <path>" of the last
+ * returned instance, the iteration continues after it or at its position if it no longer exists
+ */
+static int
+opget_build_page_from_sysrepo(struct np2_sessions *sessions, struct lyd_node **root, const char *list_xpath,
+                              uint32_t offset, uint32_t limit, const char *cursor, uint16_t depth,
+                              struct op_mem_budget *budget, char **next_cursor, struct nc_server_reply **ereply)
+{
+    sr_val_t *value = NULL, *last = NULL;
+    sr_val_iter_t *sriter = NULL;
+    struct nc_server_error *e;
+    const char *cursor_path = NULL;
+    char *ptr;
+    unsigned long pos = 0, seen;
+    uint32_t count = 0;
+    int rc, seek = 0, ret = -1;
+
+    if (cursor) {
+        errno = 0;
+        pos = strtoul(cursor, &ptr, 10);
+        if (errno || !pos || (pos > UINT32_MAX) || (*ptr != ' ')) {
+            e = nc_err(NC_ERR_INVALID_VALUE, NC_ERR_TYPE_PROT);
+            nc_err_set_msg(e, "Cursor was not returned by this server.", "en");
+            *ereply = nc_server_reply_err(e);
             return -1;
         }
+        cursor_path = ptr + 1;
+
+        if (sessions->paging.cursor && !strcmp(sessions->paging.cursor, cursor)
+                && !strcmp(sessions->paging.xpath, list_xpath) && (sessions->paging.ds == sessions->ds)
+                && (sessions->paging.opts == sessions->opts)) {
+            /* continue the iteration of the previous page */
+            sriter = sessions->paging.iter;
+            value = sessions->paging.next;
+            sessions->paging.iter = NULL;
+            sessions->paging.next = NULL;
+        } else {
+            seek = 1;
+        }
+    }
+    op_get_paging_clear(sessions);
+
+    if (sriter) {
+        seen = pos;
+    } else {
+        seen = 0;
+        rc = np2srv_sr_get_items_iter(sessions->srs, list_xpath, &sriter, NULL);
+        if (rc == 1) {
+            /* no instances */
+            sriter = NULL;
+        } else if (rc) {
+            return -1;
+        }
+    }
+
+    /* only the list instances themselves are iterated, subtrees are fetched for the page instances */
+    while (value || (sriter && !np2srv_sr_get_item_next(sessions->srs, sriter, &value, NULL))) {
+        if (value->type != SR_LIST_T) {
+            sr_free_val(value);
+            value = NULL;
+            continue;
+        }
+        ++seen;
 
-        if (!(*root)) {
-            *root = node;
+        if (seek) {
+            if (!strcmp(value->xpath, cursor_path)) {
+                /* the page starts after the cursor instance */
+                seek = 0;
+                sr_free_val(value);
+                value = NULL;
+                continue;
+            } else if (seen < pos) {
+                sr_free_val(value);
+                value = NULL;
+                continue;
+            }
+            /* the cursor instance is gone, the page starts at its position */
+            seek = 0;
         }
-        sr_free_val(value);
+        if (offset) {
+            --offset;
+            sr_free_val(value);
+            value = NULL;
+            continue;
+        }
+
+        if (count == limit) {
+            /* there are more instances, last returned is the next cursor */
+            if (asprintf(next_cursor, "%lu %s", seen - 1, last->xpath) == -1) {
+                *next_cursor = NULL;
+                EMEM;
+                goto cleanup;
+            }
+
+            /* the next page is most likely read right away, keep the iteration */
+            sessions->paging.cursor = strdup(*next_cursor);
+            sessions->paging.xpath = strdup(list_xpath);
+            if (!sessions->paging.cursor || !sessions->paging.xpath) {
+                op_get_paging_clear(sessions);
+            } else {
+                sessions->paging.ds = sessions->ds;
+                sessions->paging.opts = sessions->opts;
+                sessions->paging.iter = sriter;
+                sessions->paging.next = value;
+                sriter = NULL;
+                value = NULL;
+            }
+            break;
+        }
+
+        if (opget_build_subtree_from_sysrepo(sessions->srs, root, value->xpath, depth, budget)) {
+            goto cleanup;
+        }
+        sr_free_val(last);
+        last = value;
+        value = NULL;
+        ++count;
     }
+
+    ret = 0;
+
+cleanup:
+    sr_free_val(value);
+    sr_free_val(last);
     sr_free_val_iter(sriter);
+    return ret;
+}
+
+/* identical reads in progress, the first one (leader) fetches the data for all the others */
+struct opget_flight {
+    char *key;
+    struct lyd_node *data;
+    char *next_cursor;
+    uint64_t mem_used;
+    uint64_t generation;    /* configuration generation the read started in */
+    uint32_t waiters;
+    int done;
+    int failed;
+    pthread_cond_t cond;
+    struct opget_flight *next;
+};
+
+static struct {
+    struct opget_flight *flights;
+    uint64_t generation;    /* changed on every commit, older reads may not include it */
+    uint64_t hits;
+    pthread_mutex_t lock;
+} opget_flights = {.flights = NULL, .generation = 0, .hits = 0, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+/* everything the read data depend on */
+static char *
+opget_flight_key(sr_datastore_t ds, unsigned int config_only, NC_WD_MODE nc_wd, const char *username, int paging,
+                 uint32_t limit, uint32_t offset, const char *cursor, uint16_t depth, char **filters, int filter_count)
+{
+    char *key, *ptr;
+    size_t len;
+    int i;
+
+    if (!cursor) {
+        cursor = "";
+    }
+
+    len = strlen(username) + strlen(cursor) + 64;
+    for (i = 0; i < filter_count; ++i) {
+        len += strlen(filters[i]) + 1;
+    }
+
+    key = malloc(len);
+    if (!key) {
+        EMEM;
+        return NULL;
+    }
+    ptr = key + sprintf(key, "%d %u %d %d %" PRIu32 " %" PRIu32 " %u %s\n%zu:%s", ds, config_only, nc_wd, paging, limit,
+                        offset, depth, username, strlen(cursor), cursor);
+    for (i = 0; i < filter_count; ++i) {
+        ptr += sprintf(ptr, "\n%s", filters[i]);
+    }
+
+    return key;
+}
+
+static void
+opget_flight_free(struct opget_flight *flight)
+{
+    free(flight->key);
+    lyd_free_withsiblings(flight->data);
+    free(flight->next_cursor);
+    pthread_cond_destroy(&flight->cond);
+    free(flight);
+}
+
+/* returns 1 if the data of an identical read were shared, 0 if they must be read (by the leader if flight is set) */
+static int
+opget_flight_join(char *key, struct opget_flight **flight, struct lyd_node **data, char **next_cursor,
+                  struct op_mem_budget *budget)
+{
+    struct opget_flight *iter;
+    int ret = 0;
+
+    *flight = NULL;
+
+    pthread_mutex_lock(&opget_flights.lock);
+    /* reads started before the last commit would not return the committed data */
+    for (iter = opget_flights.flights;
+            iter && (strcmp(iter->key, key) || (iter->generation != opget_flights.generation));
+            iter = iter->next);
+    if (!iter) {
+        /* we are the leader */
+        iter = calloc(1, sizeof *iter);
+        if (!iter) {
+            pthread_mutex_unlock(&opget_flights.lock);
+            free(key);
+            EMEM;
+            return -1;
+        }
+        iter->key = key;
+        iter->generation = opget_flights.generation;
+        pthread_cond_init(&iter->cond, NULL);
+        iter->next = opget_flights.flights;
+        opget_flights.flights = iter;
+        pthread_mutex_unlock(&opget_flights.lock);
+
+        *flight = iter;
+        return 0;
+    }
+    free(key);
+
+    /* wait for the leader */
+    ++iter->waiters;
+    while (!iter->done) {
+        pthread_cond_wait(&iter->cond, &opget_flights.lock);
+    }
+    if (!iter->failed) {
+        ++opget_flights.hits;
+    }
+    pthread_mutex_unlock(&opget_flights.lock);
+
+    /* the flight is not changed nor freed while we are waiting for it */
+    if (!iter->failed && !op_mem_charge(budget, iter->mem_used)) {
+        if (iter->data) {
+            *data = lyd_dup_withsiblings(iter->data, 1);
+            if (!*data) {
+                EMEM;
+                ret = -1;
+            }
+        }
+        if (!ret && iter->next_cursor) {
+            *next_cursor = strdup(iter->next_cursor);
+            if (!*next_cursor) {
+                EMEM;
+                ret = -1;
+            }
+        }
+        if (!ret) {
+            ret = 1;
+        }
+    } else if (budget->exceeded) {
+        ret = -1;
+    }
+
+    pthread_mutex_lock(&opget_flights.lock);
+    if (!--iter->waiters) {
+        opget_flight_free(iter);
+    }
+    pthread_mutex_unlock(&opget_flights.lock);
+
+    return ret;
+}
+
+/* leader finished, data are NULL on failure (and if there are no data) */
+static void
+opget_flight_finish(struct opget_flight *flight, int failed, const struct lyd_node *data, const char *next_cursor,
+                    uint64_t mem_used)
+{
+    struct opget_flight **iter;
+    uint32_t waiters;
+
+    /* no more followers */
+    pthread_mutex_lock(&opget_flights.lock);
+    for (iter = &opget_flights.flights; *iter != flight; iter = &(*iter)->next);
+    *iter = flight->next;
+    waiters = flight->waiters;
+    pthread_mutex_unlock(&opget_flights.lock);
+
+    if (waiters && !failed) {
+        if (data) {
+            flight->data = lyd_dup_withsiblings(data, 1);
+            if (!flight->data) {
+                EMEM;
+                failed = 1;
+            }
+        }
+        if (!failed && next_cursor) {
+            flight->next_cursor = strdup(next_cursor);
+            if (!flight->next_cursor) {
+                EMEM;
+                failed = 1;
+            }
+        }
+        flight->mem_used = mem_used;
+    }
+
+    pthread_mutex_lock(&opget_flights.lock);
+    flight->done = 1;
+    flight->failed = failed;
+    if (flight->waiters) {
+        pthread_cond_broadcast(&flight->cond);
+    } else {
+        opget_flight_free(flight);
+    }
+    pthread_mutex_unlock(&opget_flights.lock);
+}
+
+void
+op_get_shared_invalidate(void)
+{
+    pthread_mutex_lock(&opget_flights.lock);
+    ++opget_flights.generation;
+    pthread_mutex_unlock(&opget_flights.lock);
+}
+
+void
+op_get_shared_stats(uint64_t *hits)
+{
+    pthread_mutex_lock(&opget_flights.lock);
+    *hits = opget_flights.hits;
+    pthread_mutex_unlock(&opget_flights.lock);
+}
+
+/* whole running configuration of a module as visible to a user */
+struct opget_config_entry {
+    char *user;
+    const struct lys_module *module;
+    struct lyd_node *data;
+};
+
+static struct {
+    struct opget_config_entry *entries;
+    uint32_t count;         /* entries are kept in the insertion order, the oldest is evicted */
+    uint64_t gen;           /* changed on every invalidation */
+    char **subscribed;      /* modules with a change subscription */
+    uint32_t sub_count;
+    pthread_rwlock_t lock;
+} opget_config_cache = {.entries = NULL, .count = 0, .gen = 0, .subscribed = NULL, .sub_count = 0,
+                        .lock = PTHREAD_RWLOCK_INITIALIZER};
+
+/* MUST be called holding the cache lock for writing */
+static void
+opget_config_cache_remove(const char *module_name)
+{
+    uint32_t i;
+
+    for (i = 0; i < opget_config_cache.count; ) {
+        if (module_name && strcmp(opget_config_cache.entries[i].module->name, module_name)) {
+            ++i;
+            continue;
+        }
+
+        free(opget_config_cache.entries[i].user);
+        lyd_free_withsiblings(opget_config_cache.entries[i].data);
+        --opget_config_cache.count;
+        memmove(&opget_config_cache.entries[i], &opget_config_cache.entries[i + 1],
+                (opget_config_cache.count - i) * sizeof *opget_config_cache.entries);
+    }
+    ++opget_config_cache.gen;
+}
+
+static int
+opget_config_change_cb(sr_session_ctx_t *UNUSED(session), const char *module_name, sr_notif_event_t UNUSED(event),
+                       void *UNUSED(private_ctx))
+{
+    pthread_rwlock_wrlock(&opget_config_cache.lock);
+    if (!strcmp(module_name, "ietf-netconf-acm")) {
+        /* access rights of the users could have changed */
+        opget_config_cache_remove(NULL);
+    } else {
+        opget_config_cache_remove(module_name);
+    }
+    pthread_rwlock_unlock(&opget_config_cache.lock);
+
+    return SR_ERR_OK;
+}
+
+/* make sure the cached data of the module are dropped on every change */
+static int
+opget_config_cache_subscribe(const char *module_name)
+{
+    char **subscribed;
+    uint32_t i;
+
+    pthread_rwlock_rdlock(&opget_config_cache.lock);
+    for (i = 0; i < opget_config_cache.sub_count; ++i) {
+        if (!strcmp(opget_config_cache.subscribed[i], module_name)) {
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&opget_config_cache.lock);
+    if (i < opget_config_cache.sub_count) {
+        return 0;
+    }
+
+    /* cannot hold the lock, sysrepo may reconnect and reset the cache, concurrent subscriptions are harmless */
+    if (np2srv_sr_module_change_subscribe(np2srv.sr_sess.srs, module_name, opget_config_change_cb, NULL, 0,
+            SR_SUBSCR_PASSIVE | SR_SUBSCR_APPLY_ONLY | SR_SUBSCR_CTX_REUSE, &np2srv.sr_subscr, NULL)) {
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&opget_config_cache.lock);
+    subscribed = realloc(opget_config_cache.subscribed, (opget_config_cache.sub_count + 1) * sizeof *subscribed);
+    if (!subscribed) {
+        pthread_rwlock_unlock(&opget_config_cache.lock);
+        EMEM;
+        return -1;
+    }
+    opget_config_cache.subscribed = subscribed;
+    subscribed[opget_config_cache.sub_count] = strdup(module_name);
+    if (!subscribed[opget_config_cache.sub_count]) {
+        pthread_rwlock_unlock(&opget_config_cache.lock);
+        EMEM;
+        return -1;
+    }
+    ++opget_config_cache.sub_count;
+    pthread_rwlock_unlock(&opget_config_cache.lock);
+
+    return 0;
+}
+
+/* module of the data selected by a simple absolute filter */
+static const struct lys_module *
+opget_config_cache_module(const char *filter)
+{
+    const char *ptr;
+    char *name, quot;
+    size_t len;
+    const struct lys_module *module;
+
+    if ((filter[0] != '/') || (filter[1] == '/') || strchr(filter, '|')) {
+        return NULL;
+    }
+
+    ptr = strchr(filter, ':');
+    if (!ptr || (strcspn(filter + 1, "/[") < (unsigned)(ptr - filter - 1))) {
+        return NULL;
+    }
+
+    name = strndup(filter + 1, ptr - filter - 1);
+    if (!name) {
+        EMEM;
+        return NULL;
+    }
+
+    /* nodes of other modules (augments) may be changed without notifying about a change of this module */
+    for (ptr = filter, quot = 0; *ptr; ++ptr) {
+        if (quot) {
+            if (*ptr == quot) {
+                quot = 0;
+            }
+        } else if ((*ptr == '\'') || (*ptr == '\"')) {
+            quot = *ptr;
+        } else if (*ptr == ':') {
+            for (len = 0; (ptr - len > filter) && (isalnum(ptr[-len - 1]) || strchr("_-.", ptr[-len - 1])); ++len);
+            if ((len != strlen(name)) || strncmp(ptr - len, name, len)) {
+                free(name);
+                return NULL;
+            }
+        }
+    }
+    module = ly_ctx_get_module(np2srv.ly_ctx, name, NULL, 1);
+    free(name);
+
+    return module;
+}
+
+/* add the running configuration selected by a filter, 1 returned if the filter cannot be served by the cache */
+static int
+opget_config_cache_get(sr_session_ctx_t *srs, const char *user, const char *filter, uint16_t depth,
+                       struct op_mem_budget *budget, struct lyd_node **root)
+{
+    const struct lys_module *module;
+    struct opget_config_entry *entry;
+    struct lyd_node *data = NULL;
+    char *xpath;
+    uint64_t gen;
+    uint32_t i;
+    int ret;
+
+    module = opget_config_cache_module(filter);
+    if (!module) {
+        return 1;
+    }
+
+    pthread_rwlock_rdlock(&opget_config_cache.lock);
+    for (i = 0; i < opget_config_cache.count; ++i) {
+        entry = &opget_config_cache.entries[i];
+        if ((entry->module == module) && !strcmp(entry->user, user)) {
+            ret = entry->data ? op_filter_get_tree_from_data(root, entry->data, filter, depth, budget) : 0;
+            pthread_rwlock_unlock(&opget_config_cache.lock);
+            return ret;
+        }
+    }
+    pthread_rwlock_unlock(&opget_config_cache.lock);
+
+    /* subscribe before reading so that no change is missed */
+    if (opget_config_cache_subscribe(module->name) || opget_config_cache_subscribe("ietf-netconf-acm")) {
+        return -1;
+    }
+
+    pthread_rwlock_rdlock(&opget_config_cache.lock);
+    gen = opget_config_cache.gen;
+    pthread_rwlock_unlock(&opget_config_cache.lock);
+
+    /* read the whole module configuration, only the filtered copy is charged */
+    if (asprintf(&xpath, "/%s:*//.", module->name) == -1) {
+        EMEM;
+        return -1;
+    }
+    ret = op_tree_builder_fetch(srs, &data, xpath, NULL);
+    free(xpath);
+    if (ret) {
+        lyd_free_withsiblings(data);
+        return -1;
+    }
+    if (data && op_filter_get_tree_from_data(root, data, filter, depth, budget)) {
+        lyd_free_withsiblings(data);
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&opget_config_cache.lock);
+    for (i = 0; i < opget_config_cache.count; ++i) {
+        if ((opget_config_cache.entries[i].module == module) && !strcmp(opget_config_cache.entries[i].user, user)) {
+            break;
+        }
+    }
+    if ((gen != opget_config_cache.gen) || (i < opget_config_cache.count)) {
+        /* changed while we were reading or cached by someone else */
+        pthread_rwlock_unlock(&opget_config_cache.lock);
+        lyd_free_withsiblings(data);
+        return 0;
+    }
+
+    if (!opget_config_cache.entries) {
+        opget_config_cache.entries = malloc(NP2SRV_CONFIG_CACHE_SIZE * sizeof *opget_config_cache.entries);
+        if (!opget_config_cache.entries) {
+            pthread_rwlock_unlock(&opget_config_cache.lock);
+            lyd_free_withsiblings(data);
+            EMEM;
+            return -1;
+        }
+    } else if (opget_config_cache.count == NP2SRV_CONFIG_CACHE_SIZE) {
+        /* evict the oldest */
+        free(opget_config_cache.entries[0].user);
+        lyd_free_withsiblings(opget_config_cache.entries[0].data);
+        --opget_config_cache.count;
+        memmove(&opget_config_cache.entries[0], &opget_config_cache.entries[1],
+                opget_config_cache.count * sizeof *opget_config_cache.entries);
+    }
+
+    entry = &opget_config_cache.entries[opget_config_cache.count];
+    entry->user = strdup(user);
+    if (!entry->user) {
+        pthread_rwlock_unlock(&opget_config_cache.lock);
+        lyd_free_withsiblings(data);
+        EMEM;
+        return -1;
+    }
+    entry->module = module;
+    entry->data = data;
+    ++opget_config_cache.count;
+    pthread_rwlock_unlock(&opget_config_cache.lock);
+
+    return 0;
+}
+
+void
+op_config_cache_clear(void)
+{
+    if (!NP2SRV_CONFIG_CACHE_SIZE) {
+        return;
+    }
+
+    pthread_rwlock_wrlock(&opget_config_cache.lock);
+    opget_config_cache_remove(NULL);
+    pthread_rwlock_unlock(&opget_config_cache.lock);
+}
+
+void
+op_config_cache_reset(void)
+{
+    uint32_t i;
+
+    pthread_rwlock_wrlock(&opget_config_cache.lock);
+    opget_config_cache_remove(NULL);
+    free(opget_config_cache.entries);
+    opget_config_cache.entries = NULL;
+    for (i = 0; i < opget_config_cache.sub_count; ++i) {
+        free(opget_config_cache.subscribed[i]);
+    }
+    free(opget_config_cache.subscribed);
+    opget_config_cache.subscribed = NULL;
+    opget_config_cache.sub_count = 0;
+    pthread_rwlock_unlock(&opget_config_cache.lock);
+}
+
+/* operational data snapshots of a configured subtree, per user */
+struct opget_state_snapshot {
+    char *user;
+    struct lyd_node *data;
+    struct timespec ts;
+};
+
+struct opget_state_subtree {
+    char *xpath;
+    uint32_t ttl;           /* ms */
+    struct opget_state_snapshot *snapshots;
+    uint32_t snapshot_count;
+    struct timespec last;   /* time of the most recent snapshot */
+    uint64_t hits;
+    uint64_t misses;
+};
+
+static struct {
+    struct opget_state_subtree *subtrees;
+    uint32_t count;
+    pthread_mutex_t lock;
+} opget_state_cache = {.subtrees = NULL, .count = 0, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static uint64_t
+opget_state_age(const struct timespec *ts, const struct timespec *now)
+{
+    return (uint64_t)(now->tv_sec - ts->tv_sec) * 1000 + (now->tv_nsec - ts->tv_nsec) / 1000000;
+}
+
+/* MUST be called holding the cache lock */
+static void
+opget_state_subtree_clear(struct opget_state_subtree *subtree)
+{
+    uint32_t i;
+
+    for (i = 0; i < subtree->snapshot_count; ++i) {
+        free(subtree->snapshots[i].user);
+        lyd_free_withsiblings(subtree->snapshots[i].data);
+    }
+    free(subtree->snapshots);
+    subtree->snapshots = NULL;
+    subtree->snapshot_count = 0;
+}
+
+/* MUST be called holding the cache lock, the filter must select only nodes in the subtree */
+static struct opget_state_subtree *
+opget_state_cache_find(const char *filter)
+{
+    struct opget_state_subtree *subtree;
+    size_t len;
+    uint32_t i;
+
+    if (strchr(filter, '|') || strstr(filter, "..")) {
+        return NULL;
+    }
+
+    for (i = 0; i < opget_state_cache.count; ++i) {
+        subtree = &opget_state_cache.subtrees[i];
+        len = strlen(subtree->xpath);
+        if ((len > 2) && !strcmp(subtree->xpath + len - 2, ":*")) {
+            /* whole module */
+            if (!strncmp(filter, subtree->xpath, len - 1)) {
+                return subtree;
+            }
+        } else if (!strncmp(filter, subtree->xpath, len) && (!filter[len] || (filter[len] == '/') || (filter[len] == '['))) {
+            return subtree;
+        }
+    }
+
+    return NULL;
+}
+
+/* add the data selected by a filter from a recent snapshot, 1 returned if the filter is not in a cached subtree */
+static int
+opget_state_cache_get(sr_session_ctx_t *srs, const char *user, const char *filter, uint16_t depth,
+                      struct op_mem_budget *budget, struct lyd_node **root)
+{
+    struct opget_state_subtree *subtree;
+    struct opget_state_snapshot *snapshot, *snapshots;
+    struct lyd_node *data = NULL;
+    struct timespec now;
+    char *xpath;
+    uint32_t i;
+    int ret;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&opget_state_cache.lock);
+    subtree = opget_state_cache_find(filter);
+    if (!subtree) {
+        pthread_mutex_unlock(&opget_state_cache.lock);
+        return 1;
+    }
+
+    for (i = 0; i < subtree->snapshot_count; ++i) {
+        snapshot = &subtree->snapshots[i];
+        if (!strcmp(snapshot->user, user)) {
+            if (opget_state_age(&snapshot->ts, &now) < subtree->ttl) {
+                ++subtree->hits;
+                ret = snapshot->data ? op_filter_get_tree_from_data(root, snapshot->data, filter, depth, budget) : 0;
+                pthread_mutex_unlock(&opget_state_cache.lock);
+                return ret;
+            }
+            break;
+        }
+    }
+    ++subtree->misses;
+    if (asprintf(&xpath, "%s//.", subtree->xpath) == -1) {
+        pthread_mutex_unlock(&opget_state_cache.lock);
+        EMEM;
+        return -1;
+    }
+    pthread_mutex_unlock(&opget_state_cache.lock);
+
+    /* take a new snapshot, the providers are not called with the lock held, only the filtered copy is charged */
+    ret = op_tree_builder_fetch(srs, &data, xpath, NULL);
+    if (ret || (data && op_filter_get_tree_from_data(root, data, filter, depth, budget))) {
+        free(xpath);
+        lyd_free_withsiblings(data);
+        return -1;
+    }
+    xpath[strlen(xpath) - 3] = '\0';
+
+    pthread_mutex_lock(&opget_state_cache.lock);
+    /* the configuration could have changed meanwhile */
+    for (i = 0; i < opget_state_cache.count; ++i) {
+        if (!strcmp(opget_state_cache.subtrees[i].xpath, xpath)) {
+            break;
+        }
+    }
+    free(xpath);
+    if (i == opget_state_cache.count) {
+        pthread_mutex_unlock(&opget_state_cache.lock);
+        lyd_free_withsiblings(data);
+        return 0;
+    }
+    subtree = &opget_state_cache.subtrees[i];
+
+    for (i = 0; i < subtree->snapshot_count; ++i) {
+        if (!strcmp(subtree->snapshots[i].user, user)) {
+            break;
+        }
+    }
+    if (i == subtree->snapshot_count) {
+        snapshots = realloc(subtree->snapshots, (i + 1) * sizeof *snapshots);
+        if (!snapshots || !(snapshots[i].user = strdup(user))) {
+            if (snapshots) {
+                subtree->snapshots = snapshots;
+            }
+            pthread_mutex_unlock(&opget_state_cache.lock);
+            lyd_free_withsiblings(data);
+            EMEM;
+            return -1;
+        }
+        subtree->snapshots = snapshots;
+        snapshots[i].data = NULL;
+        ++subtree->snapshot_count;
+    }
+    snapshot = &subtree->snapshots[i];
+    lyd_free_withsiblings(snapshot->data);
+    snapshot->data = data;
+    snapshot->ts = now;
+    subtree->last = now;
+    pthread_mutex_unlock(&opget_state_cache.lock);
+
+    return 0;
+}
+
+int
+op_state_cache_configure(char **xpaths, uint32_t *ttls, uint32_t count)
+{
+    struct opget_state_subtree *subtrees = NULL;
+    uint32_t i;
+
+    if (count) {
+        subtrees = calloc(count, sizeof *subtrees);
+        if (!subtrees) {
+            EMEM;
+            for (i = 0; i < count; ++i) {
+                free(xpaths[i]);
+            }
+            return -1;
+        }
+        for (i = 0; i < count; ++i) {
+            subtrees[i].xpath = xpaths[i];
+            subtrees[i].ttl = ttls[i];
+        }
+    }
+
+    pthread_mutex_lock(&opget_state_cache.lock);
+    for (i = 0; i < opget_state_cache.count; ++i) {
+        opget_state_subtree_clear(&opget_state_cache.subtrees[i]);
+        free(opget_state_cache.subtrees[i].xpath);
+    }
+    free(opget_state_cache.subtrees);
+    opget_state_cache.subtrees = subtrees;
+    opget_state_cache.count = count;
+    pthread_mutex_unlock(&opget_state_cache.lock);
+
+    return 0;
+}
+
+void
+op_state_cache_clear(void)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&opget_state_cache.lock);
+    for (i = 0; i < opget_state_cache.count; ++i) {
+        opget_state_subtree_clear(&opget_state_cache.subtrees[i]);
+    }
+    pthread_mutex_unlock(&opget_state_cache.lock);
+}
+
+int
+op_state_cache_stats(struct op_state_cache_stat **stats, uint32_t *count)
+{
+    struct opget_state_subtree *subtree;
+    struct timespec now;
+    uint32_t i;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&opget_state_cache.lock);
+    *count = opget_state_cache.count;
+    *stats = calloc(*count ? *count : 1, sizeof **stats);
+    if (!*stats) {
+        pthread_mutex_unlock(&opget_state_cache.lock);
+        EMEM;
+        return -1;
+    }
+    for (i = 0; i < *count; ++i) {
+        subtree = &opget_state_cache.subtrees[i];
+        (*stats)[i].xpath = strdup(subtree->xpath);
+        (*stats)[i].hits = subtree->hits;
+        (*stats)[i].misses = subtree->misses;
+        if (subtree->last.tv_sec || subtree->last.tv_nsec) {
+            (*stats)[i].age = opget_state_age(&subtree->last, &now);
+        } else {
+            (*stats)[i].age = -1;
+        }
+    }
+    pthread_mutex_unlock(&opget_state_cache.lock);
 
     return 0;
 }
@@ -73,24 +980,33 @@ opget_build_subtree_from_sysrepo(sr_session_ctx_t *srs, struct lyd_node **root,
 struct nc_server_reply *
 op_get(struct lyd_node *rpc, struct nc_session *ncs)
 {
-    const struct lys_module *module;
-    const struct lys_node *snode;
+    const struct lys_module *np2mod;
+    const struct op_mod_info *mods;
     struct lyd_node_leaf_list *leaf;
     struct lyd_node *root = NULL, *node, *yang_lib_data = NULL, *ncm_data = NULL, *ntf_data = NULL;
-    char **filters = NULL, *path;
-    int filter_count = 0, rc;
+    char **filters = NULL, *path, *next_cursor = NULL, *key;
+    const char *cursor = NULL, *cstr;
+    int filter_count = 0, rc, paging = 0, shared = 0, cached;
+    uint32_t limit = UINT32_MAX, offset = 0;
+    uint64_t size, valid_size;
+    uint16_t depth = 0;
     unsigned int config_only;
-    uint32_t i;
+    uint32_t i, mod_count;
     struct np2_sessions *sessions;
-    struct ly_set *nodeset;
     sr_datastore_t ds = 0;
     struct nc_server_error *e;
     struct nc_server_reply *ereply = NULL;
+    struct op_mem_budget budget;
+    enum op_mem_type mem_type;
+    struct opget_flight *flight = NULL;
     NC_WD_MODE nc_wd;
 
     /* get sysrepo connections for this session */
     sessions = (struct np2_sessions *)nc_session_get_data(ncs);
 
+    memset(&budget, 0, sizeof budget);
+    mem_type = strcmp(rpc->schema->name, "get") ? OP_MEM_GETCONFIG : OP_MEM_GET;
+
     if (!strcmp(rpc->schema->name, "get")) {
         rc = np2srv_sr_check_exec_permission(sessions->srs, "/ietf-netconf:get", &ereply);
     } else {
@@ -109,17 +1025,15 @@ op_get(struct lyd_node *rpc, struct nc_session *ncs)
         ds = SR_DS_RUNNING;
     } else { /* get-config */
         config_only = SR_SESS_CONFIG_ONLY;
-        nodeset = lyd_find_path(rpc, "/ietf-netconf:get-config/source/*");
-        if (!strcmp(nodeset->set.d[0]->schema->name, "running")) {
+        cstr = op_param_get(rpc, OP_PARAM_GETCONFIG_SOURCE)->child->schema->name;
+        if (!strcmp(cstr, "running")) {
             ds = SR_DS_RUNNING;
-        } else if (!strcmp(nodeset->set.d[0]->schema->name, "startup")) {
+        } else if (!strcmp(cstr, "startup")) {
             ds = SR_DS_STARTUP;
-        } else if (!strcmp(nodeset->set.d[0]->schema->name, "candidate")) {
+        } else if (!strcmp(cstr, "candidate")) {
             ds = SR_DS_CANDIDATE;
         }
         /* TODO URL capability */
-
-        ly_set_free(nodeset);
     }
     if (ds != sessions->ds || (sessions->opts & SR_SESS_CONFIG_ONLY) != config_only) {
         /* update sysrepo session datastore */
@@ -136,31 +1050,17 @@ op_get(struct lyd_node *rpc, struct nc_session *ncs)
     }
 
     /* create filters */
-    nodeset = lyd_find_path(rpc, "/ietf-netconf:*/filter");
-    if (nodeset->number) {
-        node = nodeset->set.d[0];
-        ly_set_free(nodeset);
+    node = op_param_get(rpc, config_only ? OP_PARAM_GETCONFIG_FILTER : OP_PARAM_GET_FILTER);
+    if (node) {
         if (op_filter_create(node, &filters, &filter_count)) {
             goto error;
         }
     } else {
-        ly_set_free(nodeset);
-
-        i = 0;
-        while ((module = ly_ctx_get_module_iter(np2srv.ly_ctx, &i))) {
-            if (!module->implemented) {
-                continue;
-            }
-
-            LY_TREE_FOR(module->data, snode) {
-                if (!(snode->nodetype & (LYS_GROUPING | LYS_NOTIF | LYS_RPC))) {
-                    /* module with some actual data definitions */
-                    break;
-                }
-            }
-
-            if (snode) {
-                asprintf(&path, "/%s:*", module->name);
+        mods = op_mod_index(&mod_count);
+        for (i = 0; i < mod_count; ++i) {
+            /* modules with some actual data definitions */
+            if (mods[i].module->implemented && (mods[i].flags & OP_MOD_DATA)) {
+                asprintf(&path, "/%s:*", mods[i].module->name);
                 if (op_filter_xpath_add_filter(path, &filters, &filter_count)) {
                     free(path);
                     goto error;
@@ -170,9 +1070,8 @@ op_get(struct lyd_node *rpc, struct nc_session *ncs)
     }
 
     /* get with-defaults mode */
-    nodeset = lyd_find_path(rpc, "/ietf-netconf:*/ietf-netconf-with-defaults:with-defaults");
-    if (nodeset->number) {
-        leaf = (struct lyd_node_leaf_list *)nodeset->set.d[0];
+    leaf = (struct lyd_node_leaf_list *)op_param_get(rpc, config_only ? OP_PARAM_GETCONFIG_WD : OP_PARAM_GET_WD);
+    if (leaf) {
         if (!strcmp(leaf->value_str, "report-all")) {
             nc_wd = NC_WD_ALL;
         } else if (!strcmp(leaf->value_str, "report-all-tagged")) {
@@ -187,12 +1086,56 @@ op_get(struct lyd_node *rpc, struct nc_session *ncs)
             goto error;
         }
     }
-    ly_set_free(nodeset);
 
+    /* get paging and depth parameters */
+    np2mod = ly_ctx_get_module(np2srv.ly_ctx, "netopeer2-server", NULL, 1);
+    if (np2mod) {
+        leaf = (struct lyd_node_leaf_list *)op_param_get(rpc,
+                config_only ? OP_PARAM_GETCONFIG_LIMIT : OP_PARAM_GET_LIMIT);
+        if (leaf) {
+            limit = leaf->value.uint32;
+            paging = 1;
+        }
+        leaf = (struct lyd_node_leaf_list *)op_param_get(rpc,
+                config_only ? OP_PARAM_GETCONFIG_OFFSET : OP_PARAM_GET_OFFSET);
+        if (leaf) {
+            offset = leaf->value.uint32;
+            paging = 1;
+        }
+        leaf = (struct lyd_node_leaf_list *)op_param_get(rpc,
+                config_only ? OP_PARAM_GETCONFIG_CURSOR : OP_PARAM_GET_CURSOR);
+        if (leaf) {
+            cursor = leaf->value_str;
+            paging = 1;
+        }
+        leaf = (struct lyd_node_leaf_list *)op_param_get(rpc,
+                config_only ? OP_PARAM_GETCONFIG_DEPTH : OP_PARAM_GET_DEPTH);
+        if (leaf) {
+            depth = leaf->value.uint16;
+        }
+
+        if (paging && ((filter_count != 1) || !opget_is_list_filter(filters[0]))) {
+            e = nc_err(NC_ERR_INVALID_VALUE, NC_ERR_TYPE_PROT);
+            nc_err_set_msg(e, "Paging requires a filter selecting instances of a single list.", "en");
+            ereply = nc_server_reply_err(e);
+            goto error;
+        }
+    }
 
     if (sessions->ds != SR_DS_CANDIDATE) {
+        /* share the data of an identical read in progress, candidate is private to the session */
+        key = opget_flight_key(sessions->ds, config_only, nc_wd, nc_session_get_username(ncs), paging, limit, offset,
+                               cursor, depth, filters, filter_count);
+        if (!key) {
+            goto error;
+        }
+        shared = opget_flight_join(key, &flight, &root, &next_cursor, &budget);
+        if (shared == -1) {
+            goto error;
+        }
+
         /* refresh sysrepo data */
-        if (np2srv_sr_session_refresh(sessions->srs, &ereply)) {
+        if (!shared && np2srv_sr_session_refresh(sessions->srs, &ereply)) {
             goto error;
         }
     } else if (!(sessions->flags & NP2S_CAND_CHANGED)) {
@@ -205,7 +1148,7 @@ op_get(struct lyd_node *rpc, struct nc_session *ncs)
     /*
      * create the data tree for the data reply
      */
-    for (i = 0; (signed)i < filter_count; i++) {
+    for (i = 0; !shared && ((signed)i < filter_count); i++) {
         /* special case, we have this data locally */
         if (!strncmp(filters[i], "/ietf-yang-library:", 19)) {
             if (config_only) {
@@ -220,7 +1163,7 @@ op_get(struct lyd_node *rpc, struct nc_session *ncs)
                 }
             }
 
-            if (op_filter_get_tree_from_data(&root, yang_lib_data, filters[i])) {
+            if (op_filter_get_tree_from_data(&root, yang_lib_data, filters[i], depth, &budget)) {
                 goto error;
             }
             continue;
@@ -237,7 +1180,7 @@ op_get(struct lyd_node *rpc, struct nc_session *ncs)
                 }
             }
 
-            if (op_filter_get_tree_from_data(&root, ncm_data, filters[i])) {
+            if (op_filter_get_tree_from_data(&root, ncm_data, filters[i], depth, &budget)) {
                 goto error;
             }
             continue;
@@ -254,14 +1197,39 @@ op_get(struct lyd_node *rpc, struct nc_session *ncs)
                 }
             }
 
-            if (op_filter_get_tree_from_data(&root, ntf_data, filters[i])) {
+            if (op_filter_get_tree_from_data(&root, ntf_data, filters[i], depth, &budget)) {
                 goto error;
             }
             continue;
         }
 
         /* create this subtree */
-        if (opget_build_subtree_from_sysrepo(sessions->srs, &root, filters[i])) {
+        if (config_only && NP2SRV_CONFIG_CACHE_SIZE && !paging && ((sessions->ds == SR_DS_RUNNING)
+                || ((sessions->ds == SR_DS_CANDIDATE) && !(sessions->flags & NP2S_CAND_CHANGED)))) {
+            /* unchanged candidate is the same as running */
+            cached = opget_config_cache_get(sessions->srs, nc_session_get_username(ncs), filters[i], depth, &budget,
+                                            &root);
+            if (cached == -1) {
+                goto error;
+            } else if (!cached) {
+                continue;
+            }
+        }
+        if (!config_only && !paging) {
+            cached = opget_state_cache_get(sessions->srs, nc_session_get_username(ncs), filters[i], depth, &budget,
+                                           &root);
+            if (cached == -1) {
+                goto error;
+            } else if (!cached) {
+                continue;
+            }
+        }
+        if (paging) {
+            if (opget_build_page_from_sysrepo(sessions, &root, filters[i], offset, limit, cursor, depth, &budget,
+                                              &next_cursor, &ereply)) {
+                goto error;
+            }
+        } else if (opget_build_subtree_from_sysrepo(sessions->srs, &root, filters[i], depth, &budget)) {
             goto error;
         }
     }
@@ -284,22 +1252,50 @@ op_get(struct lyd_node *rpc, struct nc_session *ncs)
     debug */
 
     /* build RPC Reply */
-    if (lyd_validate(&root, (config_only ? LYD_OPT_GETCONFIG : LYD_OPT_GET), np2srv.ly_ctx)) {
-        EINT;
-        goto error;
+    if (!shared) {
+        size = op_mem_tree_size(root);
+        if (lyd_validate(&root, (config_only ? LYD_OPT_GETCONFIG : LYD_OPT_GET), np2srv.ly_ctx)) {
+            EINT;
+            goto error;
+        }
+
+        /* default nodes added by the validation are sent as well */
+        valid_size = op_mem_tree_size(root);
+        if ((valid_size > size) && op_mem_charge(&budget, valid_size - size)) {
+            goto error;
+        }
+    }
+    if (flight) {
+        opget_flight_finish(flight, 0, root, next_cursor, budget.used);
+        flight = NULL;
     }
     node = root;
     root = lyd_dup(rpc, 0);
 
     lyd_new_output_anydata(root, NULL, "data", node, LYD_ANYDATA_DATATREE);
+    if (next_cursor) {
+        lyd_new_output_leaf(root, np2mod, "next-cursor", next_cursor);
+        free(next_cursor);
+        next_cursor = NULL;
+    }
     if (lyd_validate(&root, LYD_OPT_RPCREPLY, NULL)) {
         EINT;
         goto error;
     }
 
-    return nc_server_reply_data(root, nc_wd, NC_PARAMTYPE_FREE);
+    /* the reservation is kept until the reply holds the whole tree */
+    ereply = nc_server_reply_data(root, nc_wd, NC_PARAMTYPE_FREE);
+    op_mem_release(&budget, mem_type);
+    return ereply;
 
 error:
+    if (!ereply && budget.exceeded) {
+        ereply = op_mem_budget_err(&budget);
+    }
+    op_mem_release(&budget, mem_type);
+    if (flight) {
+        opget_flight_finish(flight, 1, NULL, NULL, 0);
+    }
     if (!ereply) {
         e = nc_err(NC_ERR_OP_FAILED, NC_ERR_TYPE_APP);
         nc_err_set_msg(e, np2log_lasterr(), "en");
@@ -310,6 +1306,7 @@ error:
         free(filters[i]);
     }
     free(filters);
+    free(next_cursor);
 
     lyd_free_withsiblings(yang_lib_data);
     lyd_free_withsiblings(ncm_data);
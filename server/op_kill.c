@@ -25,7 +25,7 @@ struct nc_server_reply *
 op_kill(struct lyd_node *rpc, struct nc_session *ncs)
 {
     struct np2_sessions *sessions;
-    struct ly_set *set = NULL;
+    struct lyd_node_leaf_list *sid;
     struct nc_server_error *e = NULL;
     struct nc_server_reply *ereply = NULL;
     uint32_t kill_sid;
@@ -39,8 +39,8 @@ op_kill(struct lyd_node *rpc, struct nc_session *ncs)
         goto finish;
     }
 
-    set = lyd_find_path(rpc, "session-id");
-    if (!set || (set->number != 1) || (set->set.d[0]->schema->nodetype != LYS_LEAF)) {
+    sid = (struct lyd_node_leaf_list *)op_param_get(rpc, OP_PARAM_KILL_SESSIONID);
+    if (!sid) {
         EINT;
         e = nc_err(NC_ERR_OP_FAILED, NC_ERR_TYPE_APP);
         nc_err_set_msg(e, np2log_lasterr(), "en");
@@ -48,7 +48,7 @@ op_kill(struct lyd_node *rpc, struct nc_session *ncs)
         goto finish;
     }
 
-    kill_sid = ((struct lyd_node_leaf_list *)set->set.d[0])->value.uint32;
+    kill_sid = sid->value.uint32;
 
     if (kill_sid == nc_session_get_id(ncs)) {
         e = nc_err(NC_ERR_INVALID_VALUE, NC_ERR_TYPE_PROT);
@@ -77,6 +77,5 @@ op_kill(struct lyd_node *rpc, struct nc_session *ncs)
     ereply = nc_server_reply_ok();
 
 finish:
-    ly_set_free(set);
     return ereply;
 }
@@ -144,7 +144,7 @@ np2srv_ntf_send(struct np_subscriber *subscriber, struct lyd_node *ntf, time_t t
         if (subscriber->filters) {
             filtered_ntf = NULL;
             for (i = 0; i < subscriber->filter_count; ++i) {
-                if (op_filter_get_tree_from_data(&filtered_ntf, ntf, subscriber->filters[i])) {
+                if (op_filter_get_tree_from_data(&filtered_ntf, ntf, subscriber->filters[i], 0, NULL)) {
                     free(datetime);
                     lyd_free(filtered_ntf);
                     return;
@@ -184,7 +184,8 @@ np2srv_ntf_clb(const sr_ev_notif_type_t notif_type, const char *xpath, const sr_
                time_t timestamp, void *private_ctx)
 {
     struct np_subscriber *subscriber = (struct np_subscriber *)private_ctx;
-    struct lyd_node *ntf = NULL, *node;
+    struct lyd_node *ntf = NULL;
+    struct op_tree_builder builder;
     size_t i;
     const char *ntf_type_str = NULL;
 
@@ -213,12 +214,16 @@ np2srv_ntf_clb(const sr_ev_notif_type_t notif_type, const char *xpath, const sr_
             goto error;
         }
 
+        memset(&builder, 0, sizeof builder);
+        builder.root = ntf;
         for (i = 0; i < val_cnt; i++) {
-            if (op_sr_val_to_lyd_node(ntf, &vals[i], &node)) {
+            if (op_tree_builder_add(&builder, &vals[i])) {
                 ERR("Creating notification (%s) data (%s) failed.", xpath, vals[i].xpath);
+                op_tree_builder_clean(&builder);
                 goto error;
             }
         }
+        op_tree_builder_clean(&builder);
     }
 
     /* send the notification */
@@ -231,30 +236,19 @@ error:
 static int
 ntf_module_sr_subscribe(const struct lys_module *mod, struct np_subscriber *subscr)
 {
-    struct lys_node *next, *snode, *top;
     int rc;
 
-    LY_TREE_FOR(mod->data, top) {
-        LY_TREE_DFS_BEGIN(top, next, snode) {
-            if (snode->nodetype == LYS_NOTIF) {
-                if (subscr->sr_subscr) {
-                    rc = np2srv_sr_event_notif_subscribe(np2srv.sr_sess.srs, mod->name, np2srv_ntf_clb, subscr,
-                                                SR_SUBSCR_NOTIF_REPLAY_FIRST | SR_SUBSCR_CTX_REUSE, &subscr->sr_subscr, NULL);
-                } else {
-                    rc = np2srv_sr_event_notif_subscribe(np2srv.sr_sess.srs, mod->name, np2srv_ntf_clb, subscr,
-                                                SR_SUBSCR_NOTIF_REPLAY_FIRST, &subscr->sr_subscr, NULL);
-                }
-                if (rc) {
-                    return -1;
-                }
-                return 1;
-            }
-
-            LY_TREE_DFS_END(top, next, snode);
-        }
+    if (subscr->sr_subscr) {
+        rc = np2srv_sr_event_notif_subscribe(np2srv.sr_sess.srs, mod->name, np2srv_ntf_clb, subscr,
+                                    SR_SUBSCR_NOTIF_REPLAY_FIRST | SR_SUBSCR_CTX_REUSE, &subscr->sr_subscr, NULL);
+    } else {
+        rc = np2srv_sr_event_notif_subscribe(np2srv.sr_sess.srs, mod->name, np2srv_ntf_clb, subscr,
+                                    SR_SUBSCR_NOTIF_REPLAY_FIRST, &subscr->sr_subscr, NULL);
     }
-
-    return 0;
+    if (rc) {
+        return -1;
+    }
+    return 1;
 }
 
 static void
@@ -285,7 +279,8 @@ op_ntf_subscribe(struct lyd_node *rpc, struct nc_session *ncs)
 {
     int ret, filter_count;
     uint16_t i;
-    uint32_t idx;
+    uint32_t idx, mod_count;
+    const struct op_mod_info *mods;
     time_t now = time(NULL), start = 0, stop = 0;
     const char *stream;
     char **filters;
@@ -403,8 +398,9 @@ op_ntf_subscribe(struct lyd_node *rpc, struct nc_session *ncs)
     /* subscribe to all the notifications */
     if (!strcmp(stream, "NETCONF")) {
         /* default stream (all models) */
-        idx = 0;
-        while ((mod = ly_ctx_get_module_iter(np2srv.ly_ctx, &idx))) {
+        mods = op_mod_index(&mod_count);
+        for (idx = 0; idx < mod_count; ++idx) {
+            mod = mods[idx].module;
             if (!strcmp(mod->name, "nc-notifications")) {
                 /* do not subscribe to replayComplete and notificationComplete,
                  * they are generated by sysrepo itself */
@@ -414,6 +410,9 @@ op_ntf_subscribe(struct lyd_node *rpc, struct nc_session *ncs)
                  * ignore it if sysrepo also implements this model */
                 new->subscr_ietf_yang_library = 1;
                 continue;
+            } else if (!(mods[idx].flags & OP_MOD_NOTIF)) {
+                /* module has no notification */
+                continue;
             }
 
             ret = ntf_module_sr_subscribe(mod, new);
@@ -449,7 +448,7 @@ op_ntf_subscribe(struct lyd_node *rpc, struct nc_session *ncs)
                 ereply = nc_server_reply_err(e);
                 goto unlock_error;
             }
-        } else if (!mod || !(ret = ntf_module_sr_subscribe(mod, new))) {
+        } else if (!mod || !(op_mod_index_flags(mod) & OP_MOD_NOTIF) || !(ret = ntf_module_sr_subscribe(mod, new))) {
             /* requested stream does not match any schema with a notification */
             e = nc_err(NC_ERR_BAD_ELEM, NC_ERR_TYPE_PROT, "stream");
             nc_err_set_msg(e, "Requested stream name does not match any of the provided streams.", "en");
@@ -556,9 +555,9 @@ op_ntf_yang_lib_change(const struct lyd_node *ylib_info)
 struct lyd_node *
 ntf_get_data(void)
 {
-    uint32_t idx = 0;
+    uint32_t idx, mod_count;
     struct lyd_node *root, *stream;
-    struct lys_node *snode;
+    const struct op_mod_info *mods;
     const struct lys_module *mod;
     const char *replay_sup;
 
@@ -581,13 +580,10 @@ ntf_get_data(void)
     }
 
     /* local streams - matching a module specifying a notifications */
-    while ((mod = ly_ctx_get_module_iter(np2srv.ly_ctx, &idx))) {
-        LY_TREE_FOR(mod->data, snode) {
-            if (snode->nodetype == LYS_NOTIF) {
-                break;
-            }
-        }
-        if (!snode) {
+    mods = op_mod_index(&mod_count);
+    for (idx = 0; idx < mod_count; ++idx) {
+        mod = mods[idx].module;
+        if (!(mods[idx].flags & OP_MOD_NOTIF_TOP)) {
             /* module has no notification */
             continue;
         }
@@ -35,7 +35,6 @@ op_lock(struct lyd_node *rpc, struct nc_session *ncs)
     sr_datastore_t ds = 0;
     struct nc_session **dsl = NULL;
     time_t *dst;
-    struct ly_set *nodeset;
     struct nc_server_error *e;
     struct nc_server_reply *ereply = NULL;
     const char *dsname;
@@ -48,15 +47,21 @@ op_lock(struct lyd_node *rpc, struct nc_session *ncs)
     }
 
     /* get know which datastore is being affected */
-    nodeset = lyd_find_path(rpc, "/ietf-netconf:lock/target/*");
-    dsname = nodeset->set.d[0]->schema->name;
-    ly_set_free(nodeset);
+    dsname = op_param_get(rpc, OP_PARAM_LOCK_TARGET)->child->schema->name;
 
     if (!strcmp(dsname, "running")) {
-        /* TODO additional requirements in case of supporting confirmed-commit */
         ds = SR_DS_RUNNING;
         dsl = &dslock.running;
         dst = &dslock.running_time;
+
+        if (op_confirmed_other(ncs)) {
+            ERR("Locking datastore %s by session %d failed (confirmed commit of another session is pending).",
+                dsname, nc_session_get_id(ncs));
+            e = nc_err(NC_ERR_LOCK_DENIED, 0);
+            nc_err_set_msg(e, np2log_lasterr(), "en");
+            ereply = nc_server_reply_err(e);
+            goto finish;
+        }
     } else if (!strcmp(dsname, "startup")) {
         ds = SR_DS_STARTUP;
         dsl = &dslock.startup;
@@ -130,7 +135,6 @@ op_unlock(struct lyd_node *rpc, struct nc_session *ncs)
     sr_datastore_t ds = 0;
     struct nc_session **dsl = NULL;
     time_t *dst;
-    struct ly_set *nodeset;
     const char *dsname;
     struct nc_server_error *e;
     struct nc_server_reply *ereply = NULL;
@@ -143,9 +147,7 @@ op_unlock(struct lyd_node *rpc, struct nc_session *ncs)
     }
 
     /* get know which datastore is being affected */
-    nodeset = lyd_find_path(rpc, "/ietf-netconf:unlock/target/*");
-    dsname = nodeset->set.d[0]->schema->name;
-    ly_set_free(nodeset);
+    dsname = op_param_get(rpc, OP_PARAM_UNLOCK_TARGET)->child->schema->name;
 
     if (!strcmp(dsname, "running")) {
         ds = SR_DS_RUNNING;
@@ -213,6 +215,9 @@ op_unlock(struct lyd_node *rpc, struct nc_session *ncs)
 
     /* according to RFC 6241 8.3.5.2, discard changes */
     np2srv_sr_discard_changes(sessions->srs, NULL);
+    if (sessions->ds == SR_DS_CANDIDATE) {
+        op_cand_clear(sessions);
+    }
 
     /* update local information about locks */
     *dsl = NULL;
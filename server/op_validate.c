@@ -11,6 +11,9 @@
  *
  *     https://opensource.org/licenses/BSD-3-Clause
  */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <libyang/libyang.h>
@@ -20,16 +23,213 @@
 #include "common.h"
 #include "operations.h"
 
+/* results of validating inline <config>, concurrent requests with identical content wait for the first one */
+struct validate_cache_entry {
+    char *content;          /* NULL for a free slot */
+    uint32_t hash;
+    uint16_t set_id;        /* module-set-id of the context the content was validated in */
+    int state;
+    uint32_t waiters;
+    uint64_t last_used;     /* LRU tick */
+};
+
+#define VALIDATE_PENDING 1
+#define VALIDATE_VALID 2
+#define VALIDATE_INVALID 3
+
+static struct {
+    struct validate_cache_entry *entries;   /* NP2SRV_VALIDATE_CACHE_SIZE slots */
+    uint64_t tick;
+    uint64_t hits;
+    uint64_t misses;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} validate_cache = {.lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER};
+
+static void
+validate_cache_entry_free(struct validate_cache_entry *entry)
+{
+    free(entry->content);
+    memset(entry, 0, sizeof *entry);
+}
+
+/* content of <config> as received, NULL if it cannot be cached */
+static char *
+validate_cache_content(struct lyd_node_anydata *any)
+{
+    char *str = NULL;
+
+    switch (any->value_type) {
+    case LYD_ANYDATA_CONSTSTRING:
+    case LYD_ANYDATA_STRING:
+    case LYD_ANYDATA_SXML:
+        str = strdup(any->value.str ? any->value.str : "");
+        break;
+    case LYD_ANYDATA_XML:
+        if (!any->value.xml) {
+            str = strdup("");
+        } else {
+            lyxml_print_mem(&str, any->value.xml, LYXML_PRINT_SIBLINGS);
+        }
+        break;
+    case LYD_ANYDATA_DATATREE:
+        if (!any->value.tree) {
+            str = strdup("");
+        } else {
+            lyd_print_mem(&str, any->value.tree, LYD_XML, LYP_WITHSIBLINGS);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return str;
+}
+
+/* returns 1 if the content is known to be valid, 0 if it must be validated (and the entry finished, if set),
+ * content is spent */
+static int
+validate_cache_join(char *content, struct validate_cache_entry **entry)
+{
+    struct validate_cache_entry *iter, *slot = NULL;
+    uint32_t hash, i;
+    uint16_t set_id;
+    int ret = 0;
+
+    *entry = NULL;
+    hash = op_str_hash(content, strlen(content));
+    set_id = ly_ctx_get_module_set_id(np2srv.ly_ctx);
+
+    pthread_mutex_lock(&validate_cache.lock);
+
+    if (!validate_cache.entries) {
+        validate_cache.entries = calloc(NP2SRV_VALIDATE_CACHE_SIZE, sizeof *validate_cache.entries);
+        if (!validate_cache.entries) {
+            pthread_mutex_unlock(&validate_cache.lock);
+            EMEM;
+            free(content);
+            return 0;
+        }
+    }
+
+    for (i = 0; i < NP2SRV_VALIDATE_CACHE_SIZE; ++i) {
+        iter = &validate_cache.entries[i];
+        if (!iter->content) {
+            if (!slot || slot->content) {
+                slot = iter;
+            }
+            continue;
+        }
+        if ((iter->hash == hash) && (iter->set_id == set_id) && !strcmp(iter->content, content)) {
+            break;
+        }
+        if ((iter->state == VALIDATE_VALID) && (!slot || (slot->content && (iter->last_used < slot->last_used)))) {
+            /* least recently used, can be evicted */
+            slot = iter;
+        }
+    }
+
+    if (i < NP2SRV_VALIDATE_CACHE_SIZE) {
+        free(content);
+        if (iter->state == VALIDATE_PENDING) {
+            ++iter->waiters;
+            while (iter->state == VALIDATE_PENDING) {
+                pthread_cond_wait(&validate_cache.cond, &validate_cache.lock);
+            }
+            --iter->waiters;
+        }
+
+        if (iter->state == VALIDATE_VALID) {
+            iter->last_used = ++validate_cache.tick;
+            ++validate_cache.hits;
+            ret = 1;
+        } else if (!iter->waiters) {
+            /* invalid, every request generates its own errors */
+            validate_cache_entry_free(iter);
+        }
+        pthread_mutex_unlock(&validate_cache.lock);
+        return ret;
+    }
+
+    ++validate_cache.misses;
+    if (slot) {
+        if (slot->content) {
+            validate_cache_entry_free(slot);
+        }
+        slot->content = content;
+        slot->hash = hash;
+        slot->set_id = set_id;
+        slot->state = VALIDATE_PENDING;
+        slot->last_used = ++validate_cache.tick;
+        *entry = slot;
+    } else {
+        /* all the slots are being validated */
+        free(content);
+    }
+
+    pthread_mutex_unlock(&validate_cache.lock);
+    return 0;
+}
+
+static void
+validate_cache_finish(struct validate_cache_entry *entry, int valid)
+{
+    if (!entry) {
+        return;
+    }
+
+    pthread_mutex_lock(&validate_cache.lock);
+    entry->state = valid ? VALIDATE_VALID : VALIDATE_INVALID;
+    if (!valid && !entry->waiters) {
+        validate_cache_entry_free(entry);
+    }
+    pthread_cond_broadcast(&validate_cache.cond);
+    pthread_mutex_unlock(&validate_cache.lock);
+}
+
+void
+op_validate_cache_clear(void)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&validate_cache.lock);
+    for (i = 0; validate_cache.entries && (i < NP2SRV_VALIDATE_CACHE_SIZE); ++i) {
+        if (validate_cache.entries[i].content && (validate_cache.entries[i].state != VALIDATE_PENDING)
+                && !validate_cache.entries[i].waiters) {
+            validate_cache_entry_free(&validate_cache.entries[i]);
+        }
+    }
+    pthread_mutex_unlock(&validate_cache.lock);
+}
+
+void
+op_validate_cache_stats(uint32_t *count, uint64_t *hits, uint64_t *misses)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&validate_cache.lock);
+    *count = 0;
+    for (i = 0; validate_cache.entries && (i < NP2SRV_VALIDATE_CACHE_SIZE); ++i) {
+        if (validate_cache.entries[i].state == VALIDATE_VALID) {
+            ++*count;
+        }
+    }
+    *hits = validate_cache.hits;
+    *misses = validate_cache.misses;
+    pthread_mutex_unlock(&validate_cache.lock);
+}
+
 struct nc_server_reply *
 op_validate(struct lyd_node *rpc, struct nc_session *ncs)
 {
     struct np2_sessions *sessions;
-    struct ly_set *nodeset = NULL;
     struct nc_server_error *e = NULL;
     struct nc_server_reply *ereply;
-    struct lyd_node *config = NULL;
+    struct lyd_node *config = NULL, *src;
     struct lyd_node_anydata *any;
+    struct validate_cache_entry *entry = NULL;
     const char *dsname;
+    char *content;
     sr_datastore_t ds = SR_DS_CANDIDATE;
 
     /* get sysrepo connections for this session */
@@ -40,8 +240,8 @@ op_validate(struct lyd_node *rpc, struct nc_session *ncs)
     }
 
     /* get know which datastore is being affected */
-    nodeset = lyd_find_path(rpc, "/ietf-netconf:validate/source/*");
-    dsname = nodeset->set.d[0]->schema->name;
+    src = op_param_get(rpc, OP_PARAM_VALIDATE_SOURCE)->child;
+    dsname = src->schema->name;
     if (!strcmp(dsname, "running")) {
         ds = SR_DS_RUNNING;
     } else if (!strcmp(dsname, "startup")) {
@@ -49,8 +249,16 @@ op_validate(struct lyd_node *rpc, struct nc_session *ncs)
     } else if (!strcmp(dsname, "candidate")) {
         ds = SR_DS_CANDIDATE;
     } else if (!strcmp(dsname, "config")) {
+        any = (struct lyd_node_anydata *)src;
+
+        /* identical content was already validated in this context (or is being validated right now) */
+        if (NP2SRV_VALIDATE_CACHE_SIZE && (content = validate_cache_content(any))
+                && validate_cache_join(content, &entry)) {
+            ereply = nc_server_reply_ok();
+            goto finish;
+        }
+
         /* get data tree to validate */
-        any = (struct lyd_node_anydata *)nodeset->set.d[0];
         switch (any->value_type) {
         case LYD_ANYDATA_CONSTSTRING:
         case LYD_ANYDATA_STRING:
@@ -69,6 +277,7 @@ op_validate(struct lyd_node *rpc, struct nc_session *ncs)
         case LYD_ANYDATA_JSOND:
         case LYD_ANYDATA_SXMLD:
             EINT;
+            validate_cache_finish(entry, 0);
             e = nc_err(NC_ERR_OP_FAILED, NC_ERR_TYPE_APP);
             nc_err_set_msg(e, np2log_lasterr(), "en");
             ereply = nc_server_reply_err(e);
@@ -78,6 +287,7 @@ op_validate(struct lyd_node *rpc, struct nc_session *ncs)
         /* cleanup */
         lyd_free_withsiblings(config);
 
+        validate_cache_finish(entry, ly_errno == LY_SUCCESS);
         if (ly_errno != LY_SUCCESS) {
             e = nc_err_libyang();
             ereply = nc_server_reply_err(e);
@@ -111,6 +321,5 @@ op_validate(struct lyd_node *rpc, struct nc_session *ncs)
     ereply = nc_server_reply_ok();
 
 finish:
-    ly_set_free(nodeset);
     return ereply;
 }
@@ -15,6 +15,8 @@
 #define _GNU_SOURCE
 
 #include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
 #include <assert.h>
 #include <inttypes.h>
 #include <string.h>
@@ -1393,6 +1395,12 @@ np2srv_sr_commit(sr_session_ctx_t *srs, struct nc_server_reply **ereply)
     if (rc != SR_ERR_OK) {
         return -1;
     }
+
+    /* do not wait for the change notification, the session may read its changes right away */
+    op_config_cache_clear();
+    /* operational data may depend on the configuration */
+    op_state_cache_clear();
+    op_get_shared_invalidate();
     return 0;
 }
 
@@ -1494,6 +1502,13 @@ np2srv_sr_copy_config(sr_session_ctx_t *srs, const char *module_name, sr_datasto
     if (rc != SR_ERR_OK) {
         return -1;
     }
+
+    if (dst_datastore == SR_DS_RUNNING) {
+        /* do not wait for the change notification, the session may read its changes right away */
+        op_config_cache_clear();
+        op_state_cache_clear();
+        op_get_shared_invalidate();
+    }
     return 0;
 }
 
@@ -1799,10 +1814,200 @@ np2srv_sr_get_schema(sr_session_ctx_t *srs, const char *module_name, const char
     return 0;
 }
 
+uint32_t
+op_str_hash(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/* fraction-digits of decimal64 leaves, keyed by their paths without predicates */
+struct dec64_cache_entry {
+    char *path;
+    uint32_t hash;
+    uint8_t dig;
+};
+
+static struct {
+    struct dec64_cache_entry *entries;
+    uint32_t size;          /* always a power of 2 */
+    uint32_t count;
+    pthread_rwlock_t lock;
+} dec64_cache = {.lock = PTHREAD_RWLOCK_INITIALIZER};
+
+/* path without predicates, returns its length */
+static size_t
+dec64_cache_path(const char *xpath, char *buf)
+{
+    size_t len = 0;
+    int depth = 0;
+    char quot = 0;
+
+    for (; *xpath; ++xpath) {
+        if (quot) {
+            if (*xpath == quot) {
+                quot = 0;
+            }
+        } else if (depth && ((*xpath == '\'') || (*xpath == '\"'))) {
+            quot = *xpath;
+        } else if (*xpath == '[') {
+            ++depth;
+        } else if (*xpath == ']') {
+            --depth;
+        } else if (!depth) {
+            buf[len++] = *xpath;
+        }
+    }
+    buf[len] = '\0';
+
+    return len;
+}
+
+static struct dec64_cache_entry *
+dec64_cache_find(const char *path, uint32_t hash)
+{
+    uint32_t idx;
+
+    if (!dec64_cache.size) {
+        return NULL;
+    }
+
+    for (idx = hash & (dec64_cache.size - 1); dec64_cache.entries[idx].path; idx = (idx + 1) & (dec64_cache.size - 1)) {
+        if ((dec64_cache.entries[idx].hash == hash) && !strcmp(dec64_cache.entries[idx].path, path)) {
+            return &dec64_cache.entries[idx];
+        }
+    }
+
+    return NULL;
+}
+
+static void
+dec64_cache_add(const char *path, uint32_t hash, uint8_t dig)
+{
+    struct dec64_cache_entry *entries;
+    uint32_t i, idx, size;
+
+    pthread_rwlock_wrlock(&dec64_cache.lock);
+
+    if (dec64_cache_find(path, hash)) {
+        /* added meanwhile */
+        goto cleanup;
+    }
+
+    if ((dec64_cache.count + 1) * 2 > dec64_cache.size) {
+        /* rehash */
+        size = dec64_cache.size ? dec64_cache.size * 2 : 64;
+        entries = calloc(size, sizeof *entries);
+        if (!entries) {
+            EMEM;
+            goto cleanup;
+        }
+        for (i = 0; i < dec64_cache.size; ++i) {
+            if (dec64_cache.entries[i].path) {
+                for (idx = dec64_cache.entries[i].hash & (size - 1); entries[idx].path; idx = (idx + 1) & (size - 1));
+                entries[idx] = dec64_cache.entries[i];
+            }
+        }
+        free(dec64_cache.entries);
+        dec64_cache.entries = entries;
+        dec64_cache.size = size;
+    }
+
+    for (idx = hash & (dec64_cache.size - 1); dec64_cache.entries[idx].path; idx = (idx + 1) & (dec64_cache.size - 1));
+    dec64_cache.entries[idx].path = strdup(path);
+    if (!dec64_cache.entries[idx].path) {
+        EMEM;
+        goto cleanup;
+    }
+    dec64_cache.entries[idx].hash = hash;
+    dec64_cache.entries[idx].dig = dig;
+    ++dec64_cache.count;
+
+cleanup:
+    pthread_rwlock_unlock(&dec64_cache.lock);
+}
+
+/* get fraction-digits of a decimal64 value, schema is searched only the first time for every leaf */
+static int
+dec64_get_dig(struct ly_ctx *ctx, const char *xpath, uint8_t *dig)
+{
+    struct dec64_cache_entry *entry;
+    struct lys_node_leaf *sleaf;
+    char path_buf[256], *path;
+    size_t len;
+    uint32_t hash;
+
+    len = strlen(xpath);
+    if (len < sizeof path_buf) {
+        path = path_buf;
+    } else {
+        path = malloc(len + 1);
+        if (!path) {
+            EMEM;
+            return -1;
+        }
+    }
+    len = dec64_cache_path(xpath, path);
+    hash = op_str_hash(path, len);
+
+    pthread_rwlock_rdlock(&dec64_cache.lock);
+    entry = dec64_cache_find(path, hash);
+    if (entry) {
+        *dig = entry->dig;
+    }
+    pthread_rwlock_unlock(&dec64_cache.lock);
+
+    if (!entry) {
+        sleaf = (struct lys_node_leaf *)ly_ctx_get_node(ctx, NULL, xpath, 0);
+        if (!sleaf) {
+            if (path != path_buf) {
+                free(path);
+            }
+            return -1;
+        }
+        while (sleaf->type.base == LY_TYPE_LEAFREF) {
+            sleaf = sleaf->type.info.lref.target;
+        }
+        *dig = sleaf->type.info.dec64.dig;
+
+        dec64_cache_add(path, hash, *dig);
+    }
+
+    if (path != path_buf) {
+        free(path);
+    }
+    return 0;
+}
+
+void
+op_dec64_cache_clear(void)
+{
+    uint32_t i;
+
+    pthread_rwlock_wrlock(&dec64_cache.lock);
+
+    for (i = 0; i < dec64_cache.size; ++i) {
+        free(dec64_cache.entries[i].path);
+    }
+    free(dec64_cache.entries);
+    dec64_cache.entries = NULL;
+    dec64_cache.size = 0;
+    dec64_cache.count = 0;
+
+    pthread_rwlock_unlock(&dec64_cache.lock);
+}
+
 char *
 op_get_srval(struct ly_ctx *ctx, const sr_val_t *value, char *buf)
 {
-    struct lys_node_leaf *sleaf;
+    uint8_t dig;
 
     if (!value) {
         return NULL;
@@ -1824,14 +2029,10 @@ op_get_srval(struct ly_ctx *ctx, const sr_val_t *value, char *buf)
         return value->data.bool_val ? "true" : "false";
     case SR_DECIMAL64_T:
         /* get fraction-digits */
-        sleaf = (struct lys_node_leaf *)ly_ctx_get_node(ctx, NULL, value->xpath, 0);
-        if (!sleaf) {
+        if (dec64_get_dig(ctx, value->xpath, &dig)) {
             return NULL;
         }
-        while (sleaf->type.base == LY_TYPE_LEAFREF) {
-            sleaf = sleaf->type.info.lref.target;
-        }
-        sprintf(buf, "%.*f", sleaf->type.info.dec64.dig, value->data.decimal64_val);
+        sprintf(buf, "%.*f", dig, value->data.decimal64_val);
         return buf;
     case SR_UINT8_T:
         sprintf(buf, "%u", value->data.uint8_val);
@@ -1864,7 +2065,7 @@ op_get_srval(struct ly_ctx *ctx, const sr_val_t *value, char *buf)
 }
 
 int
-op_set_srval(struct lyd_node *node, char *path, int dup, sr_val_t *val, char **val_buf)
+op_set_srval(struct lyd_node *node, char *path, int dup, sr_val_t *val, char **val_buf, struct op_arena *arena)
 {
     uint32_t i;
     struct lyd_node_leaf_list *leaf;
@@ -1941,14 +2142,20 @@ settype:
                     return -1;
                 }
             } else {
-                str = malloc(strlen(lys_main_module(leaf->value.ident->module)->name) + 1 + strlen(leaf->value.ident->name) + 1);
+                if (!dup && arena) {
+                    str = op_arena_alloc(arena, strlen(lys_main_module(leaf->value.ident->module)->name) + 1
+                                         + strlen(leaf->value.ident->name) + 1);
+                } else {
+                    str = malloc(strlen(lys_main_module(leaf->value.ident->module)->name) + 1
+                                 + strlen(leaf->value.ident->name) + 1);
+                }
                 if (NULL == str) {
                     EMEM;
                     return -1;
                 }
                 sprintf((char *)str, "%s:%s", lys_main_module(leaf->value.ident->module)->name, leaf->value.ident->name);
                 val->data.identityref_val = (char *)str;
-                if (!dup) {
+                if (!dup && !arena) {
                     (*val_buf) = (char *)str;
                 }
             }
@@ -2015,83 +2222,232 @@ settype:
     return 0;
 }
 
-int
-op_filter_get_tree_from_data(struct lyd_node **root, struct lyd_node *data, const char *subtree_path)
+/* node marks used when extracting the filtered subtrees */
+#define FILTER_MARK_ANCESTOR 0x01
+#define FILTER_MARK_MATCH    0x02
+
+struct filter_marks {
+    const struct lyd_node **nodes;
+    uint8_t *marks;
+    uint32_t size;          /* always a power of 2 */
+    uint32_t count;
+};
+
+static uint32_t
+filter_marks_idx(const struct filter_marks *fmarks, const struct lyd_node *node)
 {
-    struct ly_set *nodeset;
-    struct lyd_node *node, *node2, *key, *key2, *child, *tmp_root;
-    struct lys_node_list *slist;
-    uint16_t i, j;
+    uint32_t idx;
 
-    nodeset = lyd_find_path(data, subtree_path);
-    for (i = 0; i < nodeset->number; ++i) {
-        node = nodeset->set.d[i];
-        tmp_root = lyd_dup(node, 1);
-        if (!tmp_root) {
+    idx = (uint32_t)(((uintptr_t)node >> 4) * 2654435761u) & (fmarks->size - 1);
+    while (fmarks->nodes[idx] && (fmarks->nodes[idx] != node)) {
+        idx = (idx + 1) & (fmarks->size - 1);
+    }
+
+    return idx;
+}
+
+static uint8_t
+filter_marks_get(const struct filter_marks *fmarks, const struct lyd_node *node)
+{
+    uint32_t idx;
+
+    idx = filter_marks_idx(fmarks, node);
+    return fmarks->nodes[idx] ? fmarks->marks[idx] : 0;
+}
+
+/* returns the previous mark of the node, -1 on error */
+static int
+filter_marks_add(struct filter_marks *fmarks, const struct lyd_node *node, uint8_t mark)
+{
+    struct filter_marks new_marks;
+    uint32_t i, idx;
+    uint8_t prev;
+
+    if ((fmarks->count + 1) * 2 > fmarks->size) {
+        /* rehash */
+        new_marks.size = fmarks->size ? fmarks->size * 2 : 64;
+        new_marks.count = fmarks->count;
+        new_marks.nodes = calloc(new_marks.size, sizeof *new_marks.nodes);
+        new_marks.marks = malloc(new_marks.size * sizeof *new_marks.marks);
+        if (!new_marks.nodes || !new_marks.marks) {
             EMEM;
+            free(new_marks.nodes);
+            free(new_marks.marks);
             return -1;
         }
-        for (node = node->parent; node; node = node->parent) {
-            node2 = lyd_dup(node, 0);
-            if (!node2) {
-                EMEM;
-                return -1;
-            }
-            if (lyd_insert(node2, tmp_root)) {
-                EINT;
-                lyd_free(node2);
-                return -1;
+        for (i = 0; i < fmarks->size; ++i) {
+            if (fmarks->nodes[i]) {
+                idx = filter_marks_idx(&new_marks, fmarks->nodes[i]);
+                new_marks.nodes[idx] = fmarks->nodes[i];
+                new_marks.marks[idx] = fmarks->marks[i];
             }
-            tmp_root = node2;
+        }
+        free(fmarks->nodes);
+        free(fmarks->marks);
+        *fmarks = new_marks;
+    }
 
-            /* we want to include all list keys in the result */
-            if (node2->schema->nodetype == LYS_LIST) {
-                slist = (struct lys_node_list *)node2->schema;
-                for (j = 0, key = node->child; j < slist->keys_size; ++j, key = key->next) {
-                    assert((struct lys_node *)slist->keys[j] == key->schema);
+    idx = filter_marks_idx(fmarks, node);
+    if (fmarks->nodes[idx]) {
+        prev = fmarks->marks[idx];
+    } else {
+        fmarks->nodes[idx] = node;
+        ++fmarks->count;
+        prev = 0;
+    }
+    fmarks->marks[idx] = prev | mark;
 
-                    /* was the key already duplicated? */
-                    LY_TREE_FOR(node2->child, child) {
-                        if (child->schema == (struct lys_node *)slist->keys[j]) {
-                            break;
-                        }
-                    }
+    return prev;
+}
 
-                    /* it wasn't */
-                    if (!child) {
-                        key2 = lyd_dup(key, 0);
-                        if (!key2) {
-                            EMEM;
-                            return -1;
-                        }
-                        if (lyd_insert(node2, key2)) {
-                            EINT;
-                            lyd_free(key2);
-                            return -1;
-                        }
-                    }
-                }
+/* emit a pruned copy of the marked node, appended to parent or to the first sibling,
+ * matched nodes are copied with depth levels of their subtree (0 for the whole subtree) */
+static int
+filter_emit_marked(const struct filter_marks *fmarks, struct lyd_node *node, uint8_t mark, uint16_t depth,
+                   struct lyd_node *parent, struct lyd_node **first)
+{
+    struct lyd_node *dup, *child, *iter;
+    uint8_t child_mark;
+    uint16_t child_depth;
 
-                /* we added those keys at the end, if some existed before the order is wrong */
-                if (lyd_schema_sort(node2->child, 0)) {
-                    EINT;
-                    return -1;
+    if ((mark & FILTER_MARK_MATCH) && !depth) {
+        /* the whole subtree is selected */
+        dup = lyd_dup(node, 1);
+    } else {
+        dup = lyd_dup(node, 0);
+    }
+    if (!dup) {
+        EMEM;
+        return -1;
+    }
+
+    if (parent) {
+        if (lyd_insert(parent, dup)) {
+            EINT;
+            lyd_free(dup);
+            return -1;
+        }
+    } else if (*first) {
+        if (lyd_insert_after((*first)->prev, dup)) {
+            EINT;
+            lyd_free(dup);
+            return -1;
+        }
+    } else {
+        *first = dup;
+    }
+
+    if (((mark & FILTER_MARK_MATCH) && !depth) || !(node->schema->nodetype & (LYS_CONTAINER | LYS_LIST))) {
+        return 0;
+    }
+
+    /* children in the data order, list keys are always included and come first */
+    LY_TREE_FOR(node->child, child) {
+        if (mark & FILTER_MARK_MATCH) {
+            /* depth-limited selected subtree */
+            child_mark = (depth > 1) ? FILTER_MARK_MATCH : 0;
+            child_depth = depth - 1;
+        } else {
+            child_mark = filter_marks_get(fmarks, child);
+            child_depth = depth;
+        }
+
+        if ((node->schema->nodetype == LYS_LIST) && (child->schema->nodetype == LYS_LEAF)
+                && lys_is_key((struct lys_node_leaf *)child->schema, NULL)) {
+            /* was the key already duplicated with the list? */
+            LY_TREE_FOR(dup->child, iter) {
+                if (iter->schema == child->schema) {
+                    break;
                 }
             }
+            if (iter) {
+                continue;
+            }
+            child_mark = FILTER_MARK_MATCH;
+            child_depth = 0;
+        }
+
+        if (child_mark && filter_emit_marked(fmarks, child, child_mark, child_depth, dup, first)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int
+op_filter_get_tree_from_data(struct lyd_node **root, struct lyd_node *data, const char *subtree_path, uint16_t depth,
+                             struct op_mem_budget *budget)
+{
+    struct ly_set *nodeset;
+    struct filter_marks fmarks;
+    struct lyd_node *node, *next, *first = NULL;
+    uint32_t i;
+    uint8_t mark;
+    int prev_mark, ret = -1;
+
+    memset(&fmarks, 0, sizeof fmarks);
+
+    nodeset = lyd_find_path(data, subtree_path);
+    if (!nodeset) {
+        return -1;
+    } else if (!nodeset->number) {
+        ly_set_free(nodeset);
+        return 0;
+    }
+
+    /* mark the selected nodes and all their ancestors */
+    for (i = 0; i < nodeset->number; ++i) {
+        if (filter_marks_add(&fmarks, nodeset->set.d[i], FILTER_MARK_MATCH) == -1) {
+            goto cleanup;
+        }
+    }
+    for (i = 0; i < nodeset->number; ++i) {
+        for (node = nodeset->set.d[i]->parent; node; node = node->parent) {
+            prev_mark = filter_marks_add(&fmarks, node, FILTER_MARK_ANCESTOR);
+            if (prev_mark == -1) {
+                goto cleanup;
+            } else if (prev_mark & FILTER_MARK_ANCESTOR) {
+                /* the rest of the ancestors were marked by a previous node */
+                break;
+            }
+        }
+    }
+
+    /* emit one pruned copy of all the marked top-level trees */
+    for (node = data; node->prev->next; node = node->prev);
+    for (; node; node = node->next) {
+        mark = filter_marks_get(&fmarks, node);
+        if (mark && filter_emit_marked(&fmarks, node, mark, depth, NULL, &first)) {
+            goto cleanup;
         }
+    }
+
+    if (budget && op_mem_charge(budget, op_mem_tree_size(first))) {
+        goto cleanup;
+    }
 
-        if (*root) {
-            if (lyd_merge(*root, tmp_root, LYD_OPT_DESTRUCT)) {
+    if (!*root) {
+        *root = first;
+    } else {
+        LY_TREE_FOR_SAFE(first, next, node) {
+            lyd_unlink(node);
+            if (lyd_merge(*root, node, LYD_OPT_DESTRUCT)) {
                 EINT;
-                return -1;
+                first = next;
+                goto cleanup;
             }
-        } else {
-            *root = tmp_root;
         }
     }
-    ly_set_free(nodeset);
+    first = NULL;
+    ret = 0;
 
-    return 0;
+cleanup:
+    lyd_free_withsiblings(first);
+    free(fmarks.nodes);
+    free(fmarks.marks);
+    ly_set_free(nodeset);
+    return ret;
 }
 
 static int
@@ -2124,86 +2480,273 @@ op_filter_xpath_add_filter(char *new_filter, char ***filters, int *filter_count)
     return 0;
 }
 
+/* simple location path without unions, only these can be compared textually */
 static int
-filter_xpath_buf_add_attrs(struct ly_ctx *ctx, struct lyxml_attr *attr, char **buf, int size)
+filter_is_simple(const char *filter)
 {
-    const struct lys_module *module;
-    struct lyxml_attr *next;
-    int new_size;
-    char *buf_new;
+    char quot = 0;
 
-    LY_TREE_FOR(attr, next) {
-        if (next->type == LYXML_ATTR_STD) {
-            module = NULL;
-            if (next->ns) {
-                module = ly_ctx_get_module_by_ns(ctx, next->ns->value, NULL, 1);
-            }
-            if (!module) {
-                /* attribute without namespace or with unknown one will not match anything anyway */
-                continue;
-            }
+    if (filter[0] != '/') {
+        return 0;
+    }
 
-            new_size = size + 2 + strlen(module->name) + 1 + strlen(next->name) + 2 + strlen(next->value) + 2;
-            buf_new = realloc(*buf, new_size * sizeof(char));
-            if (!buf_new) {
-                EMEM;
-                return -1;
+    for (; *filter; ++filter) {
+        if (quot) {
+            if (*filter == quot) {
+                quot = 0;
             }
-            *buf = buf_new;
-            sprintf((*buf) + (size - 1), "[@%s:%s='%s']", module->name, next->name, next->value);
-            size = new_size;
+        } else if ((*filter == '\'') || (*filter == '\"')) {
+            quot = *filter;
+        } else if (*filter == '|') {
+            return 0;
         }
     }
 
-    return size;
+    return 1;
 }
 
-/* top-level content node with optional namespace and attributes */
+/* filter selects a subset of the subtrees selected by container */
 static int
-filter_xpath_buf_add_top_content(struct ly_ctx *ctx, struct lyxml_elem *elem, const char *elem_module_name,
-                                char ***filters, int *filter_count)
+filter_is_contained(const char *filter, const char *container)
 {
-    int size, len;
-    const char *start;
-    char *buf;
+    size_t len;
 
-    /* skip leading and trailing whitespaces */
-    for (start = elem->content; isspace(*start); ++start);
-    for (len = strlen(start); isspace(start[len - 1]); --len);
+    len = strlen(container);
+    if (strncmp(filter, container, len) || ((filter[len] != '/') && (filter[len] != '['))) {
+        return 0;
+    }
 
-    size = 1 + strlen(elem_module_name) + 1 + strlen(elem->name) + 9 + len + 3;
-    buf = malloc(size * sizeof(char));
-    if (!buf) {
-        EMEM;
-        return -1;
+    /* the rest must only descend or restrict */
+    filter += len;
+    if (strstr(filter, "..") || strstr(filter, "::")) {
+        return 0;
     }
-    sprintf(buf, "/%s:%s[text()='%.*s']", elem_module_name, elem->name, len, start);
 
-    size = filter_xpath_buf_add_attrs(ctx, elem->attr, &buf, size);
-    if (!size) {
-        free(buf);
+    return 1;
+}
+
+/* index of the opening bracket of the only predicate of the last step, 0 if there is none */
+static size_t
+filter_last_predicate(const char *filter)
+{
+    size_t i, len;
+    int depth = 0;
+    char quot = 0;
+
+    len = strlen(filter);
+    if (!len || (filter[len - 1] != ']')) {
         return 0;
-    } else if (size < 1) {
-        free(buf);
-        return -1;
     }
 
-    if (op_filter_xpath_add_filter(buf, filters, filter_count)) {
-        free(buf);
-        return -1;
+    for (i = len; i; --i) {
+        if (quot) {
+            if (filter[i - 1] == quot) {
+                quot = 0;
+            }
+        } else if ((filter[i - 1] == '\'') || (filter[i - 1] == '\"')) {
+            quot = filter[i - 1];
+        } else if (filter[i - 1] == ']') {
+            ++depth;
+        } else if ((filter[i - 1] == '[') && !--depth) {
+            break;
+        }
+    }
+    if ((i < 2) || quot || (filter[i - 2] == ']')) {
+        /* no predicate or more predicates */
+        return 0;
     }
 
-    return 0;
+    /* positional predicates cannot be merged */
+    if (isdigit(filter[i]) || strstr(filter + i, "position()") || strstr(filter + i, "last()")) {
+        return 0;
+    }
+
+    return i - 1;
 }
 
-/* content node with optional namespace and attributes */
+/* merge "P[c1]" and "P[c2]" into "P[(c1) or (c2)]", filter is spent on success */
 static int
-filter_xpath_buf_add_content(struct ly_ctx *ctx, struct lyxml_elem *elem, const char *elem_module_name,
-                            const char **last_ns, char **buf, int size)
+filter_merge_predicate(char **merged, int first, char *filter, size_t pred_idx)
 {
-    const struct lys_module *module;
-    int new_size, len;
-    const char *start;
+    size_t len, pred_len;
+    char *buf, *ptr;
+
+    len = strlen(*merged);
+    pred_len = strlen(filter + pred_idx + 1) - 1;
+    buf = malloc(len + pred_len + 11);
+    if (!buf) {
+        EMEM;
+        return -1;
+    }
+
+    ptr = buf;
+    if (first) {
+        /* enclose the original condition */
+        ptr += sprintf(ptr, "%.*s(%.*s)", (int)(pred_idx + 1), *merged, (int)(len - pred_idx - 2), *merged + pred_idx + 1);
+    } else {
+        ptr += sprintf(ptr, "%.*s", (int)(len - 1), *merged);
+    }
+    sprintf(ptr, " or (%.*s)]", (int)pred_len, filter + pred_idx + 1);
+
+    free(*merged);
+    *merged = buf;
+    free(filter);
+    return 0;
+}
+
+/* remove duplicate and contained filters and merge sibling predicates so that the data are fetched only once */
+static int
+filter_normalize(char **filters, int *filter_count)
+{
+    int i, j, count;
+    size_t pred_i, pred_j;
+    uint8_t *merged;
+
+    count = *filter_count;
+    if (count < 2) {
+        return 0;
+    }
+
+    /* duplicate and contained filters */
+    for (i = 0; i < count; ++i) {
+        if (!filter_is_simple(filters[i])) {
+            continue;
+        }
+        for (j = 0; j < count; ++j) {
+            if ((i == j) || !filter_is_simple(filters[j])) {
+                continue;
+            }
+            if ((!strcmp(filters[i], filters[j]) && (j < i)) || filter_is_contained(filters[i], filters[j])) {
+                break;
+            }
+        }
+        if (j < count) {
+            /* keep the order of the rest */
+            free(filters[i]);
+            memmove(&filters[i], &filters[i + 1], (count - i - 1) * sizeof *filters);
+            --count;
+            --i;
+        }
+    }
+
+    /* sibling predicates, remember the filters with already merged predicates */
+    merged = calloc(count, sizeof *merged);
+    if (!merged) {
+        EMEM;
+        *filter_count = count;
+        return -1;
+    }
+    for (i = 0; i < count; ++i) {
+        if (!filter_is_simple(filters[i]) || !(pred_i = filter_last_predicate(filters[i]))) {
+            continue;
+        }
+        for (j = i + 1; j < count; ++j) {
+            if (!filter_is_simple(filters[j]) || !(pred_j = filter_last_predicate(filters[j])) || (pred_i != pred_j)
+                    || strncmp(filters[i], filters[j], pred_i)) {
+                continue;
+            }
+
+            if (filter_merge_predicate(&filters[i], !merged[i], filters[j], pred_i)) {
+                break;
+            }
+            merged[i] = 1;
+            memmove(&filters[j], &filters[j + 1], (count - j - 1) * sizeof *filters);
+            memmove(&merged[j], &merged[j + 1], (count - j - 1) * sizeof *merged);
+            --count;
+            --j;
+        }
+        if (j < count) {
+            free(merged);
+            *filter_count = count;
+            return -1;
+        }
+    }
+    free(merged);
+
+    *filter_count = count;
+    return 0;
+}
+
+static int
+filter_xpath_buf_add_attrs(struct ly_ctx *ctx, struct lyxml_attr *attr, char **buf, int size)
+{
+    const struct lys_module *module;
+    struct lyxml_attr *next;
+    int new_size;
+    char *buf_new;
+
+    LY_TREE_FOR(attr, next) {
+        if (next->type == LYXML_ATTR_STD) {
+            module = NULL;
+            if (next->ns) {
+                module = ly_ctx_get_module_by_ns(ctx, next->ns->value, NULL, 1);
+            }
+            if (!module) {
+                /* attribute without namespace or with unknown one will not match anything anyway */
+                continue;
+            }
+
+            new_size = size + 2 + strlen(module->name) + 1 + strlen(next->name) + 2 + strlen(next->value) + 2;
+            buf_new = realloc(*buf, new_size * sizeof(char));
+            if (!buf_new) {
+                EMEM;
+                return -1;
+            }
+            *buf = buf_new;
+            sprintf((*buf) + (size - 1), "[@%s:%s='%s']", module->name, next->name, next->value);
+            size = new_size;
+        }
+    }
+
+    return size;
+}
+
+/* top-level content node with optional namespace and attributes */
+static int
+filter_xpath_buf_add_top_content(struct ly_ctx *ctx, struct lyxml_elem *elem, const char *elem_module_name,
+                                char ***filters, int *filter_count)
+{
+    int size, len;
+    const char *start;
+    char *buf;
+
+    /* skip leading and trailing whitespaces */
+    for (start = elem->content; isspace(*start); ++start);
+    for (len = strlen(start); isspace(start[len - 1]); --len);
+
+    size = 1 + strlen(elem_module_name) + 1 + strlen(elem->name) + 9 + len + 3;
+    buf = malloc(size * sizeof(char));
+    if (!buf) {
+        EMEM;
+        return -1;
+    }
+    sprintf(buf, "/%s:%s[text()='%.*s']", elem_module_name, elem->name, len, start);
+
+    size = filter_xpath_buf_add_attrs(ctx, elem->attr, &buf, size);
+    if (!size) {
+        free(buf);
+        return 0;
+    } else if (size < 1) {
+        free(buf);
+        return -1;
+    }
+
+    if (op_filter_xpath_add_filter(buf, filters, filter_count)) {
+        free(buf);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* content node with optional namespace and attributes */
+static int
+filter_xpath_buf_add_content(struct ly_ctx *ctx, struct lyxml_elem *elem, const char *elem_module_name,
+                            const char **last_ns, char **buf, int size)
+{
+    const struct lys_module *module;
+    int new_size, len;
+    const char *start;
     char *buf_new;
 
     if (!elem_module_name && elem->ns && (elem->ns->value != *last_ns)
@@ -2452,13 +2995,236 @@ error:
     return -1;
 }
 
+/* cache of compiled filters, shared by all the sessions */
+struct filter_cache_entry {
+    char *key;              /* normalized filter content prefixed with its type */
+    uint32_t hash;
+    char **filters;         /* compiled XPath filters */
+    int filter_count;
+    uint64_t last_used;     /* LRU tick */
+};
+
+static struct {
+    struct filter_cache_entry entries[NP2SRV_FILTER_CACHE_SIZE];
+    uint32_t count;
+    uint64_t tick;
+    uint64_t hits;
+    uint64_t misses;
+    pthread_mutex_t lock;
+} filter_cache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/*
+ * build the cache key, whitespace-only text between XML tags does not change the compiled filter,
+ * attribute values, comments, CDATA and any other text content are kept exactly
+ */
+static char *
+filter_cache_key(char type, const char *content)
+{
+    char *key, quote = 0;
+    const char *ptr, *end;
+    int i, tag_end = 1, in_tag = 0;
+
+    key = malloc(strlen(content) + 2);
+    if (!key) {
+        EMEM;
+        return NULL;
+    }
+
+    key[0] = type;
+    i = 1;
+    for (ptr = content; *ptr; ++ptr) {
+        if (type != 's') {
+            /* XPath is kept as it is */
+        } else if (in_tag) {
+            if (quote) {
+                if (*ptr == quote) {
+                    quote = 0;
+                }
+            } else if ((*ptr == '"') || (*ptr == '\'')) {
+                quote = *ptr;
+            } else if (*ptr == '>') {
+                in_tag = 0;
+                tag_end = i + 1;
+            }
+        } else if (*ptr == '<') {
+            if (!strncmp(ptr, "<!--", 4)) {
+                end = strstr(ptr + 4, "-->");
+            } else if (!strncmp(ptr, "<![CDATA[", 9)) {
+                end = strstr(ptr + 9, "]]>");
+            } else {
+                end = NULL;
+                in_tag = 1;
+            }
+            if (end) {
+                /* copy it up to its final '>' */
+                memcpy(key + i, ptr, end + 2 - ptr);
+                i += end + 2 - ptr;
+                ptr = end + 2;
+            } else if (!in_tag) {
+                /* unterminated, copy the rest */
+                strcpy(key + i, ptr);
+                return key;
+            }
+        } else if (isspace(*ptr) && (i == tag_end)) {
+            for (end = ptr; isspace(*end); ++end);
+            if (!*end || (*end == '<')) {
+                /* whitespace-only text between tags */
+                ptr = end - 1;
+                continue;
+            }
+        }
+        key[i++] = *ptr;
+    }
+    key[i] = '\0';
+
+    return key;
+}
+
+static void
+filter_cache_entry_free(struct filter_cache_entry *entry)
+{
+    int i;
+
+    free(entry->key);
+    for (i = 0; i < entry->filter_count; ++i) {
+        free(entry->filters[i]);
+    }
+    free(entry->filters);
+    memset(entry, 0, sizeof *entry);
+}
+
+static int
+filter_dup_append(char **src, int src_count, char ***filters, int *filter_count)
+{
+    char *path;
+    int i;
+
+    for (i = 0; i < src_count; ++i) {
+        path = strdup(src[i]);
+        if (!path) {
+            EMEM;
+            return -1;
+        }
+        if (op_filter_xpath_add_filter(path, filters, filter_count)) {
+            free(path);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* return 1 on cache hit, 0 on miss, -1 on error */
+static int
+filter_cache_get(const char *key, uint32_t hash, char ***filters, int *filter_count)
+{
+    uint32_t i;
+    int ret = 0;
+
+    pthread_mutex_lock(&filter_cache.lock);
+
+    for (i = 0; i < filter_cache.count; ++i) {
+        if ((filter_cache.entries[i].hash == hash) && !strcmp(filter_cache.entries[i].key, key)) {
+            break;
+        }
+    }
+
+    if (i < filter_cache.count) {
+        filter_cache.entries[i].last_used = ++filter_cache.tick;
+        ++filter_cache.hits;
+        if (filter_dup_append(filter_cache.entries[i].filters, filter_cache.entries[i].filter_count, filters, filter_count)) {
+            ret = -1;
+        } else {
+            ret = 1;
+        }
+    } else {
+        ++filter_cache.misses;
+    }
+
+    pthread_mutex_unlock(&filter_cache.lock);
+    return ret;
+}
+
+/* key is spent */
+static void
+filter_cache_add(char *key, uint32_t hash, char **filters, int filter_count)
+{
+    struct filter_cache_entry *entry;
+    uint32_t i;
+
+    pthread_mutex_lock(&filter_cache.lock);
+
+    for (i = 0; i < filter_cache.count; ++i) {
+        if ((filter_cache.entries[i].hash == hash) && !strcmp(filter_cache.entries[i].key, key)) {
+            /* added by another thread meanwhile */
+            free(key);
+            goto cleanup;
+        }
+    }
+
+    if (filter_cache.count < NP2SRV_FILTER_CACHE_SIZE) {
+        entry = &filter_cache.entries[filter_cache.count++];
+    } else {
+        /* evict the least recently used filter */
+        entry = &filter_cache.entries[0];
+        for (i = 1; i < filter_cache.count; ++i) {
+            if (filter_cache.entries[i].last_used < entry->last_used) {
+                entry = &filter_cache.entries[i];
+            }
+        }
+        filter_cache_entry_free(entry);
+    }
+
+    entry->key = key;
+    entry->hash = hash;
+    entry->last_used = ++filter_cache.tick;
+    if (filter_dup_append(filters, filter_count, &entry->filters, &entry->filter_count)) {
+        /* do not keep an incomplete entry */
+        filter_cache_entry_free(entry);
+        *entry = filter_cache.entries[--filter_cache.count];
+        memset(&filter_cache.entries[filter_cache.count], 0, sizeof *entry);
+    }
+
+cleanup:
+    pthread_mutex_unlock(&filter_cache.lock);
+}
+
+void
+op_filter_cache_clear(void)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&filter_cache.lock);
+
+    for (i = 0; i < filter_cache.count; ++i) {
+        filter_cache_entry_free(&filter_cache.entries[i]);
+    }
+    filter_cache.count = 0;
+
+    pthread_mutex_unlock(&filter_cache.lock);
+}
+
+void
+op_filter_cache_stats(uint32_t *count, uint64_t *hits, uint64_t *misses)
+{
+    pthread_mutex_lock(&filter_cache.lock);
+
+    *count = filter_cache.count;
+    *hits = filter_cache.hits;
+    *misses = filter_cache.misses;
+
+    pthread_mutex_unlock(&filter_cache.lock);
+}
+
 int
 op_filter_create(struct lyd_node *filter_node, char ***filters, int *filter_count)
 {
     struct lyd_attr *attr;
     struct lyxml_elem *subtree_filter;
     int free_filter, ret;
-    char *path;
+    char *path, *str, *key = NULL;
+    uint32_t hash = 0;
+    int start = *filter_count, count;
 
     LY_TREE_FOR(filter_node->attr, attr) {
         if (!strcmp(attr->name, "type")) {
@@ -2492,18 +3258,44 @@ op_filter_create(struct lyd_node *filter_node, char ***filters, int *filter_coun
         switch (((struct lyd_node_anydata *)filter_node)->value_type) {
         case LYD_ANYDATA_CONSTSTRING:
         case LYD_ANYDATA_STRING:
-            subtree_filter = lyxml_parse_mem(np2srv.ly_ctx, ((struct lyd_node_anydata *)filter_node)->value.str, LYXML_PARSE_MULTIROOT);
-            free_filter = 1;
+            key = filter_cache_key('s', ((struct lyd_node_anydata *)filter_node)->value.str);
             break;
         case LYD_ANYDATA_XML:
-            subtree_filter = ((struct lyd_node_anydata *)filter_node)->value.xml;
-            free_filter = 0;
+            /* namespaces are printed as well so they are part of the key */
+            if (lyxml_print_mem(&str, ((struct lyd_node_anydata *)filter_node)->value.xml, LYXML_PRINT_SIBLINGS) < 0) {
+                return -1;
+            }
+            key = filter_cache_key('s', str ? str : "");
+            free(str);
             break;
         default:
             /* filter cannot be parsed as lyd_node tree */
             return -1;
         }
+        if (!key) {
+            return -1;
+        }
+
+        hash = op_str_hash(key, strlen(key));
+        ret = filter_cache_get(key, hash, filters, filter_count);
+        if (ret) {
+            free(key);
+            return (ret == 1) ? 0 : -1;
+        }
+
+        switch (((struct lyd_node_anydata *)filter_node)->value_type) {
+        case LYD_ANYDATA_CONSTSTRING:
+        case LYD_ANYDATA_STRING:
+            subtree_filter = lyxml_parse_mem(np2srv.ly_ctx, ((struct lyd_node_anydata *)filter_node)->value.str, LYXML_PARSE_MULTIROOT);
+            free_filter = 1;
+            break;
+        default:
+            subtree_filter = ((struct lyd_node_anydata *)filter_node)->value.xml;
+            free_filter = 0;
+            break;
+        }
         if (!subtree_filter) {
+            free(key);
             return -1;
         }
 
@@ -2512,6 +3304,7 @@ op_filter_create(struct lyd_node *filter_node, char ***filters, int *filter_coun
             lyxml_free(np2srv.ly_ctx, subtree_filter);
         }
         if (ret) {
+            free(key);
             return -1;
         }
     } else {
@@ -2520,39 +3313,1057 @@ op_filter_create(struct lyd_node *filter_node, char ***filters, int *filter_coun
             /* empty select, okay, I guess... */
             return 0;
         }
+
+        key = filter_cache_key('x', attr->value_str);
+        if (!key) {
+            return -1;
+        }
+        hash = op_str_hash(key, strlen(key));
+        ret = filter_cache_get(key, hash, filters, filter_count);
+        if (ret) {
+            free(key);
+            return (ret == 1) ? 0 : -1;
+        }
+
         path = strdup(attr->value_str);
         if (!path) {
             EMEM;
+            free(key);
             return -1;
         }
         if (op_filter_xpath_add_filter(path, filters, filter_count)) {
             free(path);
+            free(key);
             return -1;
         }
     }
 
+    /* minimal set of filters to fetch, cache it normalized */
+    count = *filter_count - start;
+    ret = filter_normalize(*filters + start, &count);
+    *filter_count = start + count;
+    if (ret) {
+        free(key);
+        return -1;
+    }
+
+    filter_cache_add(key, hash, *filters + start, *filter_count - start);
     return 0;
 }
 
-int
-op_sr_val_to_lyd_node(struct lyd_node *root, const sr_val_t *sr_val, struct lyd_node **new_node)
+/* length of the first step of the path starting with '/' */
+static size_t
+tree_builder_step_len(const char *path)
 {
-    char numstr[22];
-    char *str;
+    size_t i;
+    char quot = 0;
 
-    str = op_get_srval(np2srv.ly_ctx, sr_val, numstr);
-    if (!str) {
-        str = "";
+    for (i = 1; path[i]; ++i) {
+        if (quot) {
+            if (path[i] == quot) {
+                quot = 0;
+            }
+        } else if ((path[i] == '\'') || (path[i] == '\"')) {
+            quot = path[i];
+        } else if (path[i] == '/') {
+            break;
+        }
     }
 
-    ly_errno = LY_SUCCESS;
+    return i;
+}
 
-    *new_node = lyd_new_path(root, np2srv.ly_ctx, sr_val->xpath, str,
-            (sr_val->type == SR_ANYXML_T || sr_val->type == SR_ANYDATA_T) ? LYD_ANYDATA_SXML : 0,
-            LYD_PATH_OPT_UPDATE | (sr_val->dflt ? LYD_PATH_OPT_DFLT : 0));
-    if (ly_errno) {
-        return -1;
-    }
+static int
+tree_builder_reserve(struct op_tree_builder *builder, uint16_t depth, size_t path_len)
+{
+    struct lyd_node **nodes;
+    size_t *path_lens;
+    char *path;
+
+    if (depth > builder->size) {
+        nodes = realloc(builder->nodes, (depth + 16) * sizeof *nodes);
+        if (!nodes) {
+            EMEM;
+            return -1;
+        }
+        builder->nodes = nodes;
+        path_lens = realloc(builder->path_lens, (depth + 16) * sizeof *path_lens);
+        if (!path_lens) {
+            EMEM;
+            return -1;
+        }
+        builder->path_lens = path_lens;
+        builder->size = depth + 16;
+    }
+
+    if (path_len + 1 > builder->path_size) {
+        path = realloc(builder->path, path_len + 1);
+        if (!path) {
+            EMEM;
+            return -1;
+        }
+        builder->path = path;
+        builder->path_size = path_len + 1;
+    }
+
+    return 0;
+}
+
+int
+op_tree_builder_add(struct op_tree_builder *builder, const sr_val_t *sr_val)
+{
+    const char *xpath = sr_val->xpath;
+    char numstr[22], *str;
+    struct lyd_node *node, *parent, *iter;
+    size_t common = 0, start = 0, len;
+    uint16_t count, j;
+    int i;
+
+    str = op_get_srval(np2srv.ly_ctx, sr_val, numstr);
+    if (!str) {
+        str = "";
+    }
+
+    /* find the deepest cursor node that is an ancestor of the new node */
+    i = builder->depth - 1;
+    if (builder->depth) {
+        len = builder->path_lens[builder->depth - 1];
+        while ((common < len) && (xpath[common] == builder->path[common])) {
+            ++common;
+        }
+        for (; i > -1; --i) {
+            if ((builder->path_lens[i] <= common) && (xpath[builder->path_lens[i]] == '/')) {
+                break;
+            }
+        }
+    }
+
+    /* create the node relative to the ancestor, if found, otherwise resolve the whole path */
+    ly_errno = LY_SUCCESS;
+    if (i > -1) {
+        parent = builder->nodes[i];
+        start = builder->path_lens[i];
+        node = lyd_new_path(parent, np2srv.ly_ctx, xpath + start + 1, str,
+                (sr_val->type == SR_ANYXML_T || sr_val->type == SR_ANYDATA_T) ? LYD_ANYDATA_SXML : 0,
+                LYD_PATH_OPT_UPDATE | LYD_PATH_OPT_NOPARENTRET | (sr_val->dflt ? LYD_PATH_OPT_DFLT : 0));
+    } else {
+        parent = NULL;
+        node = lyd_new_path(builder->root, np2srv.ly_ctx, xpath, str,
+                (sr_val->type == SR_ANYXML_T || sr_val->type == SR_ANYDATA_T) ? LYD_ANYDATA_SXML : 0,
+                LYD_PATH_OPT_UPDATE | LYD_PATH_OPT_NOPARENTRET | (sr_val->dflt ? LYD_PATH_OPT_DFLT : 0));
+    }
+    if (ly_errno) {
+        return -1;
+    }
+
+    /* the ancestors deeper than the parent are not ancestors of the following nodes */
+    builder->depth = i + 1;
+    if (!node) {
+        /* node existed */
+        return 0;
+    }
+
+    if (!builder->root) {
+        for (iter = node; iter->parent; iter = iter->parent);
+        builder->root = iter;
+    }
+
+    if (builder->budget) {
+        /* all the nodes created by the path, the existing ancestors of a top-level path are included as well */
+        count = 0;
+        for (iter = node; iter && (iter != parent); iter = iter->parent) {
+            ++count;
+        }
+        if (op_mem_charge(builder->budget, count * sizeof(struct lyd_node_leaf_list) + strlen(str))) {
+            return -1;
+        }
+    }
+
+    /* move the cursor to the new node (or its parent), add all the created inner nodes */
+    count = 0;
+    for (iter = (node->schema->nodetype & (LYS_CONTAINER | LYS_LIST)) ? node : node->parent; iter != parent; iter = iter->parent) {
+        ++count;
+    }
+    if (tree_builder_reserve(builder, builder->depth + count, strlen(xpath))) {
+        return -1;
+    }
+    len = start;
+    for (j = 0; j < count; ++j) {
+        len += tree_builder_step_len(xpath + len);
+        builder->path_lens[builder->depth + j] = len;
+    }
+    if ((node->schema->nodetype & (LYS_CONTAINER | LYS_LIST)) ? xpath[len] : (xpath[len] != '/')) {
+        /* unexpected path format, do not use the cursor */
+        builder->depth = 0;
+        return 0;
+    }
+    for (j = count, iter = (node->schema->nodetype & (LYS_CONTAINER | LYS_LIST)) ? node : node->parent; j; --j, iter = iter->parent) {
+        builder->nodes[builder->depth + j - 1] = iter;
+    }
+    builder->depth += count;
+    memcpy(builder->path, xpath, len);
+    builder->path[len] = '\0';
+
+    return 0;
+}
+
+void
+op_tree_builder_clean(struct op_tree_builder *builder)
+{
+    free(builder->nodes);
+    free(builder->path_lens);
+    free(builder->path);
+    memset(builder, 0, sizeof *builder);
+}
+
+int
+op_tree_builder_fetch(sr_session_ctx_t *srs, struct lyd_node **root, const char *xpath, struct op_mem_budget *budget)
+{
+    sr_val_t *value;
+    sr_val_iter_t *sriter;
+    struct op_tree_builder builder;
+    int rc;
+
+    rc = np2srv_sr_get_items_iter(srs, xpath, &sriter, NULL);
+    if (rc == 1) {
+        /* it's ok, model without data */
+        return 0;
+    } else if (rc) {
+        return -1;
+    }
+
+    memset(&builder, 0, sizeof builder);
+    builder.root = *root;
+    builder.budget = budget;
+    while ((!np2srv_sr_get_item_next(srs, sriter, &value, NULL))) {
+        if (op_tree_builder_add(&builder, value)) {
+            sr_free_val(value);
+            sr_free_val_iter(sriter);
+            *root = builder.root;
+            op_tree_builder_clean(&builder);
+            return -1;
+        }
+        sr_free_val(value);
+    }
+    sr_free_val_iter(sriter);
+
+    *root = builder.root;
+    op_tree_builder_clean(&builder);
+    return 0;
+}
+
+int
+op_sessions_config_only(struct np2_sessions *sessions, struct nc_server_reply **ereply)
+{
+    if (sessions->opts & SR_SESS_CONFIG_ONLY) {
+        return 0;
+    }
+
+    /* state data would be deleted when the fetched data are written back */
+    if (np2srv_sr_session_set_options(sessions->srs, sessions->opts | SR_SESS_CONFIG_ONLY, ereply)) {
+        return -1;
+    }
+    sessions->opts |= SR_SESS_CONFIG_ONLY;
+    return 0;
+}
+
+/* create the node and all its descendants, list keys are created with their list */
+static int
+diff_create_subtree(sr_session_ctx_t *srs, struct lyd_node *subtree, struct nc_server_reply **ereply)
+{
+    struct lyd_node *next, *elem;
+    sr_val_t value;
+    char *path, *valbuf;
+    int ret;
+
+    LY_TREE_DFS_BEGIN(subtree, next, elem) {
+        if (elem->dflt || ((elem->schema->nodetype == LYS_CONTAINER)
+                && !((struct lys_node_container *)elem->schema)->presence)
+                || ((elem->schema->nodetype == LYS_LEAF) && lys_is_key((struct lys_node_leaf *)elem->schema, NULL))) {
+            /* created implicitly */
+            goto dfs_next;
+        }
+
+        path = lyd_path(elem);
+        if (!path) {
+            EMEM;
+            return -1;
+        }
+        memset(&value, 0, sizeof value);
+        op_set_srval(elem, path, 0, &value, &valbuf, NULL);
+        ret = np2srv_sr_set_item(srs, path, &value, 0, ereply);
+        free(valbuf);
+        free(path);
+        if (ret) {
+            return ret;
+        }
+
+dfs_next:
+        LY_TREE_DFS_END(subtree, next, elem);
+    }
+
+    return 0;
+}
+
+int
+op_diff_apply(sr_session_ctx_t *srs, struct lyd_difflist *diff, struct nc_server_reply **ereply)
+{
+    sr_val_t value;
+    char *path = NULL, *rel = NULL, *valbuf;
+    uint32_t i;
+    int ret = 0;
+
+    for (i = 0; !ret && (diff->type[i] != LYD_DIFF_END); ++i) {
+        switch (diff->type[i]) {
+        case LYD_DIFF_DELETED:
+            path = lyd_path(diff->first[i]);
+            if (!path) {
+                EMEM;
+                return -1;
+            }
+            DBG("DIFF: delete %s", path);
+            ret = np2srv_sr_delete_item(srs, path, 0, ereply);
+            break;
+        case LYD_DIFF_CHANGED:
+            path = lyd_path(diff->second[i]);
+            if (!path) {
+                EMEM;
+                return -1;
+            }
+            DBG("DIFF: change %s", path);
+            memset(&value, 0, sizeof value);
+            op_set_srval(diff->second[i], path, 0, &value, &valbuf, NULL);
+            ret = np2srv_sr_set_item(srs, path, &value, 0, ereply);
+            free(valbuf);
+            break;
+        case LYD_DIFF_CREATED:
+            DBG("DIFF: create %s", diff->second[i]->schema->name);
+            ret = diff_create_subtree(srs, diff->second[i], ereply);
+            break;
+        case LYD_DIFF_MOVEDAFTER1:
+        case LYD_DIFF_MOVEDAFTER2:
+            /* first is the moved instance, second the instance it follows (none if it is the first one) */
+            path = lyd_path(diff->first[i]);
+            if (!path || (diff->second[i] && !(rel = lyd_path(diff->second[i])))) {
+                EMEM;
+                free(path);
+                return -1;
+            }
+            DBG("DIFF: move %s after %s", path, rel ? rel : "nothing");
+            ret = np2srv_sr_move_item(srs, path, rel ? SR_MOVE_AFTER : SR_MOVE_FIRST, rel, ereply);
+            free(rel);
+            rel = NULL;
+            break;
+        case LYD_DIFF_END:
+            break;
+        }
+        free(path);
+        path = NULL;
+    }
+
+    return ret;
+}
+
+/* global memory budget shared by all the RPCs, reserved in chunks to avoid locking for every node */
+#define MEM_BUDGET_CHUNK 65536
+
+static struct {
+    uint64_t used;
+    uint64_t peak[OP_MEM_TYPE_COUNT];
+    pthread_mutex_t lock;
+} mem_budget = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+int
+op_mem_charge(struct op_mem_budget *budget, uint64_t size)
+{
+    uint64_t chunk;
+
+    budget->used += size;
+    if (NP2SRV_RPC_MEM_LIMIT && (budget->used > NP2SRV_RPC_MEM_LIMIT)) {
+        ERR("Reply exceeds the memory limit of a single RPC (%" PRIu64 " bytes).", (uint64_t)NP2SRV_RPC_MEM_LIMIT);
+        budget->exceeded = NC_ERR_TOO_BIG;
+        return -1;
+    }
+
+    if (budget->used <= budget->reserved) {
+        return 0;
+    }
+
+    /* reserve more from the global budget */
+    chunk = ((budget->used - budget->reserved) / MEM_BUDGET_CHUNK + 1) * MEM_BUDGET_CHUNK;
+    pthread_mutex_lock(&mem_budget.lock);
+    if (NP2SRV_MEM_LIMIT && (mem_budget.used + chunk > NP2SRV_MEM_LIMIT)) {
+        pthread_mutex_unlock(&mem_budget.lock);
+        ERR("Reply exceeds the memory limit of all the RPCs (%" PRIu64 " bytes).", (uint64_t)NP2SRV_MEM_LIMIT);
+        budget->exceeded = NC_ERR_RES_DENIED;
+        return -1;
+    }
+    mem_budget.used += chunk;
+    pthread_mutex_unlock(&mem_budget.lock);
+
+    budget->reserved += chunk;
+    return 0;
+}
+
+uint64_t
+op_mem_tree_size(const struct lyd_node *tree)
+{
+    const struct lyd_node *root, *next, *elem;
+    uint64_t size = 0;
+
+    /* the same estimate as of the nodes created from sysrepo values */
+    LY_TREE_FOR(tree, root) {
+        LY_TREE_DFS_BEGIN(root, next, elem) {
+            size += sizeof(struct lyd_node_leaf_list);
+            if ((elem->schema->nodetype & (LYS_LEAF | LYS_LEAFLIST)) && ((struct lyd_node_leaf_list *)elem)->value_str) {
+                size += strlen(((struct lyd_node_leaf_list *)elem)->value_str);
+            }
+            LY_TREE_DFS_END(root, next, elem);
+        }
+    }
+
+    return size;
+}
+
+void
+op_mem_release(struct op_mem_budget *budget, enum op_mem_type type)
+{
+    pthread_mutex_lock(&mem_budget.lock);
+    mem_budget.used -= budget->reserved;
+    if (budget->used > mem_budget.peak[type]) {
+        mem_budget.peak[type] = budget->used;
+    }
+    pthread_mutex_unlock(&mem_budget.lock);
+
+    memset(budget, 0, sizeof *budget);
+}
+
+struct nc_server_reply *
+op_mem_budget_err(const struct op_mem_budget *budget)
+{
+    struct nc_server_error *e;
+
+    if (budget->exceeded == NC_ERR_TOO_BIG) {
+        e = nc_err(NC_ERR_TOO_BIG, NC_ERR_TYPE_APP);
+        nc_err_set_msg(e, "Reply is too big.", "en");
+    } else {
+        e = nc_err(NC_ERR_RES_DENIED, NC_ERR_TYPE_APP);
+        nc_err_set_msg(e, "Not enough memory available for the reply, try again later.", "en");
+    }
+
+    return nc_server_reply_err(e);
+}
+
+void
+op_mem_stats(uint64_t *used, uint64_t peak[OP_MEM_TYPE_COUNT])
+{
+    pthread_mutex_lock(&mem_budget.lock);
+    *used = mem_budget.used;
+    memcpy(peak, mem_budget.peak, sizeof mem_budget.peak);
+    pthread_mutex_unlock(&mem_budget.lock);
+}
+
+/* schema properties of the context modules, in the context module order */
+static struct {
+    struct op_mod_info *mods;
+    uint32_t count;
+} mod_index;
+
+int
+op_mod_index_rebuild(void)
+{
+    const struct lys_module *mod;
+    struct lys_node *top, *next, *snode;
+    struct op_mod_info *mods;
+    uint32_t idx, count = 0;
+
+    idx = 0;
+    while (ly_ctx_get_module_iter(np2srv.ly_ctx, &idx)) {
+        ++count;
+    }
+
+    mods = realloc(mod_index.mods, count * sizeof *mods);
+    if (count && !mods) {
+        EMEM;
+        mod_index.count = 0;
+        return -1;
+    }
+    mod_index.mods = mods;
+    mod_index.count = count;
+
+    idx = 0;
+    count = 0;
+    while ((mod = ly_ctx_get_module_iter(np2srv.ly_ctx, &idx))) {
+        mods[count].module = mod;
+        mods[count].flags = 0;
+
+        LY_TREE_FOR(mod->data, top) {
+            if (!(top->nodetype & (LYS_GROUPING | LYS_NOTIF | LYS_RPC))) {
+                mods[count].flags |= OP_MOD_DATA;
+            }
+            if (top->nodetype & (LYS_CONTAINER | LYS_LIST | LYS_LEAFLIST | LYS_LEAF | LYS_ANYXML)) {
+                mods[count].flags |= (top->flags & LYS_CONFIG_R) ? OP_MOD_STATE : OP_MOD_CONFIG;
+            }
+            if (top->nodetype == LYS_NOTIF) {
+                mods[count].flags |= OP_MOD_NOTIF_TOP;
+            }
+            if (top->nodetype == LYS_RPC) {
+                mods[count].flags |= OP_MOD_RPC;
+            }
+
+            if (!(mods[count].flags & OP_MOD_NOTIF)) {
+                LY_TREE_DFS_BEGIN(top, next, snode) {
+                    if (snode->nodetype == LYS_NOTIF) {
+                        mods[count].flags |= OP_MOD_NOTIF;
+                        break;
+                    }
+                    LY_TREE_DFS_END(top, next, snode);
+                }
+            }
+        }
+
+        ++count;
+    }
+
+    return 0;
+}
+
+void
+op_mod_index_clear(void)
+{
+    free(mod_index.mods);
+    mod_index.mods = NULL;
+    mod_index.count = 0;
+}
+
+const struct op_mod_info *
+op_mod_index(uint32_t *count)
+{
+    *count = mod_index.count;
+    return mod_index.mods;
+}
+
+int
+op_mod_index_flags(const struct lys_module *module)
+{
+    uint32_t i;
+
+    for (i = 0; i < mod_index.count; ++i) {
+        if (mod_index.mods[i].module == module) {
+            return mod_index.mods[i].flags;
+        }
+    }
 
     return 0;
 }
+
+/* schema nodes of the RPC parameters, NULL if not in the context */
+static const struct lys_node *op_params[OP_PARAM_COUNT];
+
+static const char *op_param_paths[OP_PARAM_COUNT] = {
+    [OP_PARAM_GET_FILTER] = "/ietf-netconf:get/filter",
+    [OP_PARAM_GET_WD] = "/ietf-netconf:get/ietf-netconf-with-defaults:with-defaults",
+    [OP_PARAM_GET_LIMIT] = "/ietf-netconf:get/netopeer2-server:limit",
+    [OP_PARAM_GET_OFFSET] = "/ietf-netconf:get/netopeer2-server:offset",
+    [OP_PARAM_GET_CURSOR] = "/ietf-netconf:get/netopeer2-server:cursor",
+    [OP_PARAM_GET_DEPTH] = "/ietf-netconf:get/netopeer2-server:depth",
+    [OP_PARAM_GETCONFIG_SOURCE] = "/ietf-netconf:get-config/source",
+    [OP_PARAM_GETCONFIG_FILTER] = "/ietf-netconf:get-config/filter",
+    [OP_PARAM_GETCONFIG_WD] = "/ietf-netconf:get-config/ietf-netconf-with-defaults:with-defaults",
+    [OP_PARAM_GETCONFIG_LIMIT] = "/ietf-netconf:get-config/netopeer2-server:limit",
+    [OP_PARAM_GETCONFIG_OFFSET] = "/ietf-netconf:get-config/netopeer2-server:offset",
+    [OP_PARAM_GETCONFIG_CURSOR] = "/ietf-netconf:get-config/netopeer2-server:cursor",
+    [OP_PARAM_GETCONFIG_DEPTH] = "/ietf-netconf:get-config/netopeer2-server:depth",
+    [OP_PARAM_EDIT_TARGET] = "/ietf-netconf:edit-config/target",
+    [OP_PARAM_EDIT_DEFOP] = "/ietf-netconf:edit-config/default-operation",
+    [OP_PARAM_EDIT_TESTOPT] = "/ietf-netconf:edit-config/test-option",
+    [OP_PARAM_EDIT_ERROPT] = "/ietf-netconf:edit-config/error-option",
+    [OP_PARAM_EDIT_CONFIG] = "/ietf-netconf:edit-config/config",
+    [OP_PARAM_COPY_TARGET] = "/ietf-netconf:copy-config/target",
+    [OP_PARAM_COPY_SOURCE] = "/ietf-netconf:copy-config/source",
+    [OP_PARAM_DELETE_TARGET] = "/ietf-netconf:delete-config/target",
+    [OP_PARAM_LOCK_TARGET] = "/ietf-netconf:lock/target",
+    [OP_PARAM_UNLOCK_TARGET] = "/ietf-netconf:unlock/target",
+    [OP_PARAM_VALIDATE_SOURCE] = "/ietf-netconf:validate/source",
+    [OP_PARAM_KILL_SESSIONID] = "/ietf-netconf:kill-session/session-id",
+    [OP_PARAM_COMMIT_CONFIRMED] = "/ietf-netconf:commit/confirmed",
+    [OP_PARAM_COMMIT_TIMEOUT] = "/ietf-netconf:commit/confirm-timeout",
+    [OP_PARAM_COMMIT_PERSIST] = "/ietf-netconf:commit/persist",
+    [OP_PARAM_COMMIT_PERSISTID] = "/ietf-netconf:commit/persist-id",
+    [OP_PARAM_CANCEL_PERSISTID] = "/ietf-netconf:cancel-commit/persist-id",
+};
+
+void
+op_params_resolve(void)
+{
+    int i;
+
+    for (i = 0; i < OP_PARAM_COUNT; ++i) {
+        /* not all the modules must be present */
+        op_params[i] = ly_ctx_get_node(np2srv.ly_ctx, NULL, op_param_paths[i], 0);
+    }
+}
+
+struct lyd_node *
+op_param_get(const struct lyd_node *rpc, enum op_param param)
+{
+    struct lyd_node *child;
+
+    if (!op_params[param]) {
+        return NULL;
+    }
+
+    LY_TREE_FOR(rpc->child, child) {
+        if (child->schema == op_params[param]) {
+            return child;
+        }
+    }
+
+    return NULL;
+}
+
+int
+op_tree_replace(sr_session_ctx_t *srs, const char *xpath, struct lyd_node *current, struct lyd_node *data,
+                uint32_t *changes, struct nc_server_reply **ereply)
+{
+    struct lyd_difflist *diff;
+    struct lyd_node *iter;
+    uint32_t count = 0;
+    int ret = 0;
+
+    if (!data) {
+        /* remove everything */
+        if (current) {
+            count = 1;
+            ret = np2srv_sr_delete_item(srs, xpath, 0, ereply);
+        }
+    } else if (!current) {
+        /* create everything */
+        LY_TREE_FOR(data, iter) {
+            ++count;
+            ret = diff_create_subtree(srs, iter, ereply);
+            if (ret) {
+                break;
+            }
+        }
+    } else {
+        diff = lyd_diff(current, data, 0);
+        if (!diff) {
+            return -1;
+        }
+        while (diff->type[count] != LYD_DIFF_END) {
+            ++count;
+        }
+        ret = op_diff_apply(srs, diff, ereply);
+        lyd_free_diff(diff);
+    }
+
+    if (changes) {
+        *changes = count;
+    }
+    return ret;
+}
+
+/* path of all the instances of the list or leaf-list whose instance the path selects (without its predicates) */
+static char *
+undo_instances_path(const char *xpath)
+{
+    const char *ptr, *last = NULL;
+    char quot = 0;
+
+    for (ptr = xpath; *ptr; ++ptr) {
+        if (quot) {
+            if (*ptr == quot) {
+                quot = 0;
+            }
+        } else if ((*ptr == '\'') || (*ptr == '"')) {
+            quot = *ptr;
+        } else if (*ptr == '/') {
+            last = NULL;
+        } else if ((*ptr == '[') && !last) {
+            last = ptr;
+        }
+    }
+    if (!last) {
+        return NULL;
+    }
+
+    return strndup(xpath, last - xpath);
+}
+
+/* path of the instance preceding the instance of a user-ordered node, NULL if it is the first one */
+static int
+undo_prev_instance(sr_session_ctx_t *srs, const char *xpath, char **prev)
+{
+    struct lyd_node *data = NULL, *node, *iter;
+    struct ly_set *set = NULL;
+    char *inst_xpath;
+    int ret = -1;
+
+    *prev = NULL;
+
+    /* only the instances themselves, not their subtrees */
+    inst_xpath = undo_instances_path(xpath);
+    if (!inst_xpath) {
+        EINT;
+        return -1;
+    }
+    if (op_tree_builder_fetch(srs, &data, inst_xpath, NULL)) {
+        goto cleanup;
+    }
+    if (data) {
+        set = lyd_find_path(data, xpath);
+    }
+    if (!set || (set->number != 1)) {
+        /* it does not exist */
+        ret = 0;
+        goto cleanup;
+    }
+    node = set->set.d[0];
+
+    /* the previous sibling of the first sibling is the last one */
+    for (iter = node->prev; iter->next && (iter->schema != node->schema); iter = iter->prev);
+    if (iter->next) {
+        *prev = lyd_path(iter);
+        if (!*prev) {
+            EMEM;
+            goto cleanup;
+        }
+    }
+    ret = 0;
+
+cleanup:
+    ly_set_free(set);
+    lyd_free_withsiblings(data);
+    free(inst_xpath);
+    return ret;
+}
+
+static struct op_undo_entry *
+undo_new_entry(struct op_undo *undo, const char *xpath)
+{
+    struct op_undo_entry *entries;
+
+    entries = realloc(undo->entries, (undo->count + 1) * sizeof *undo->entries);
+    if (!entries) {
+        EMEM;
+        return NULL;
+    }
+    undo->entries = entries;
+
+    memset(&entries[undo->count], 0, sizeof *entries);
+    entries[undo->count].xpath = strdup(xpath);
+    if (!entries[undo->count].xpath) {
+        EMEM;
+        return NULL;
+    }
+    return &entries[undo->count++];
+}
+
+int
+op_undo_save(struct op_undo *undo, sr_session_ctx_t *srs, const char *xpath, int subtree)
+{
+    struct op_undo_entry *entry;
+    struct lyd_node *data = NULL;
+    struct ly_set *set;
+    char *fetch_xpath;
+    int ret;
+
+    if (subtree) {
+        if (asprintf(&fetch_xpath, "%s//.", xpath) == -1) {
+            EMEM;
+            return -1;
+        }
+        ret = op_tree_builder_fetch(srs, &data, fetch_xpath, NULL);
+        free(fetch_xpath);
+    } else {
+        ret = op_tree_builder_fetch(srs, &data, xpath, NULL);
+    }
+    if (ret) {
+        lyd_free_withsiblings(data);
+        return -1;
+    }
+
+    set = data ? lyd_find_path(data, xpath) : NULL;
+    if (set && (set->number == 1) && !subtree && !(set->set.d[0]->schema->nodetype & (LYS_LEAF | LYS_ANYXML))) {
+        /* existing inner node (or leaf-list instance) is not changed, only its descendants may be */
+        ly_set_free(set);
+        lyd_free_withsiblings(data);
+        return 0;
+    }
+
+    entry = undo_new_entry(undo, xpath);
+    if (!entry) {
+        ly_set_free(set);
+        lyd_free_withsiblings(data);
+        return -1;
+    }
+    if (set && (set->number == 1)) {
+        entry->data = data;
+        entry->node = set->set.d[0];
+        if ((entry->node->schema->flags & LYS_USERORDERED) && undo_prev_instance(srs, xpath, &entry->prev)) {
+            ly_set_free(set);
+            return -1;
+        }
+    } else {
+        /* it did not exist */
+        lyd_free_withsiblings(data);
+    }
+    ly_set_free(set);
+
+    return 0;
+}
+
+int
+op_undo_save_position(struct op_undo *undo, sr_session_ctx_t *srs, const char *xpath)
+{
+    struct op_undo_entry *entry;
+
+    entry = undo_new_entry(undo, xpath);
+    if (!entry) {
+        return -1;
+    }
+    entry->moved = 1;
+
+    return undo_prev_instance(srs, xpath, &entry->prev);
+}
+
+int
+op_undo_restore(struct op_undo *undo, sr_session_ctx_t *srs)
+{
+    struct op_undo_entry *entry;
+    uint32_t i;
+    int ret = 0;
+
+    /* every entry is the state right before its change, so they are replayed in the reverse order */
+    for (i = undo->count; !ret && i; --i) {
+        entry = &undo->entries[i - 1];
+
+        if (!entry->moved) {
+            ret = np2srv_sr_delete_item(srs, entry->xpath, 0, NULL);
+            if (ret || !entry->node) {
+                /* it did not exist */
+                continue;
+            }
+            /* a default leaf is restored by deleting it */
+            ret = diff_create_subtree(srs, entry->node, NULL);
+            if (ret || !(entry->node->schema->flags & LYS_USERORDERED)) {
+                continue;
+            }
+        }
+
+        /* instance recreated or moved back to its position */
+        ret = np2srv_sr_move_item(srs, entry->xpath, entry->prev ? SR_MOVE_AFTER : SR_MOVE_FIRST, entry->prev, NULL);
+    }
+
+    return ret;
+}
+
+void
+op_undo_free(struct op_undo *undo)
+{
+    uint32_t i;
+
+    for (i = 0; i < undo->count; ++i) {
+        free(undo->entries[i].xpath);
+        lyd_free_withsiblings(undo->entries[i].data);
+        free(undo->entries[i].prev);
+    }
+    free(undo->entries);
+    memset(undo, 0, sizeof *undo);
+}
+
+/* smallest arena block, the blocks grow by doubling */
+#define OP_ARENA_BLOCK_MIN 4096
+#define OP_ARENA_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+struct op_arena_block {
+    struct op_arena_block *prev;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct op_arena {
+    struct op_arena_block *block; /* current block, the older ones are linked by prev */
+    size_t size;                  /* size of all the blocks, the single block allocated after a reset */
+#ifndef NDEBUG
+    uint32_t heap_allocs;         /* blocks allocated since the last reset */
+#endif
+};
+
+static pthread_once_t op_arena_once = PTHREAD_ONCE_INIT;
+static pthread_key_t op_arena_key;
+
+static void
+op_arena_free_blocks(struct op_arena *arena)
+{
+    struct op_arena_block *prev;
+
+    while (arena->block) {
+        prev = arena->block->prev;
+        free(arena->block);
+        arena->block = prev;
+    }
+}
+
+static void
+op_arena_destroy(void *ptr)
+{
+    op_arena_free_blocks(ptr);
+    free(ptr);
+}
+
+static void
+op_arena_createkey(void)
+{
+    int r;
+
+    while ((r = pthread_key_create(&op_arena_key, op_arena_destroy)) == EAGAIN);
+}
+
+struct op_arena *
+op_arena_get(void)
+{
+    struct op_arena *arena;
+
+    pthread_once(&op_arena_once, op_arena_createkey);
+    arena = pthread_getspecific(op_arena_key);
+    if (!arena) {
+        arena = calloc(1, sizeof *arena);
+        if (!arena) {
+            EMEM;
+            return NULL;
+        }
+        pthread_setspecific(op_arena_key, arena);
+    }
+
+    return arena;
+}
+
+void *
+op_arena_alloc(struct op_arena *arena, size_t size)
+{
+    struct op_arena_block *block;
+    size_t block_size;
+    void *ptr;
+
+    size = OP_ARENA_ALIGN(size);
+    if (!arena->block || (arena->block->used + size > arena->block->size)) {
+        if (!arena->block) {
+            /* first block after a reset is big enough for the previous RPC */
+            block_size = arena->size > OP_ARENA_BLOCK_MIN ? arena->size : OP_ARENA_BLOCK_MIN;
+            arena->size = 0;
+        } else {
+            block_size = arena->block->size * 2;
+        }
+        if (block_size < size) {
+            block_size = size;
+        }
+
+        block = malloc(sizeof *block + block_size);
+        if (!block) {
+            EMEM;
+            return NULL;
+        }
+        block->prev = arena->block;
+        block->size = block_size;
+        block->used = 0;
+        arena->block = block;
+        arena->size += block_size;
+#ifndef NDEBUG
+        ++arena->heap_allocs;
+#endif
+    }
+
+    ptr = arena->block->data + arena->block->used;
+    arena->block->used += size;
+    return ptr;
+}
+
+void *
+op_arena_grow(struct op_arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+    struct op_arena_block *block = arena->block;
+    void *new_ptr;
+
+    if (ptr && block && ((char *)ptr + OP_ARENA_ALIGN(old_size) == block->data + block->used)
+            && ((char *)ptr + OP_ARENA_ALIGN(new_size) <= block->data + block->size)) {
+        /* the last allocation, enlarge it in place */
+        block->used = ((char *)ptr - block->data) + OP_ARENA_ALIGN(new_size);
+        return ptr;
+    }
+
+    new_ptr = op_arena_alloc(arena, new_size);
+    if (new_ptr && ptr) {
+        memcpy(new_ptr, ptr, old_size);
+    }
+    return new_ptr;
+}
+
+char *
+op_arena_printf(struct op_arena *arena, const char *format, ...)
+{
+    va_list ap;
+    char *str;
+    int len;
+
+    va_start(ap, format);
+    len = vsnprintf(NULL, 0, format, ap);
+    va_end(ap);
+    if (len < 0) {
+        EINT;
+        return NULL;
+    }
+
+    str = op_arena_alloc(arena, len + 1);
+    if (!str) {
+        return NULL;
+    }
+    va_start(ap, format);
+    vsprintf(str, format, ap);
+    va_end(ap);
+
+    return str;
+}
+
+struct op_arena_mark
+op_arena_mark(struct op_arena *arena)
+{
+    struct op_arena_mark mark;
+
+    mark.block = arena->block;
+    mark.used = arena->block ? arena->block->used : 0;
+    return mark;
+}
+
+void
+op_arena_release(struct op_arena *arena, struct op_arena_mark mark)
+{
+    /* memory of the older blocks is kept until the reset */
+    if (arena->block && (arena->block == mark.block)) {
+        arena->block->used = mark.used;
+    }
+}
+
+void
+op_arena_reset(struct op_arena *arena)
+{
+    if (!arena) {
+        return;
+    }
+
+#ifndef NDEBUG
+    DBG_CAT(NP2_DBG_EDIT_CONFIG, "EDIT_CONFIG: arena %zu bytes in %" PRIu32 " heap allocations.", arena->size,
+            arena->heap_allocs);
+    arena->heap_allocs = 0;
+#endif
+
+    if (arena->block && !arena->block->prev) {
+        /* single block, reuse it */
+        arena->block->used = 0;
+    } else {
+        /* merge the blocks, the size is remembered for the next allocation */
+        op_arena_free_blocks(arena);
+    }
+}
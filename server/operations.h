@@ -116,6 +116,204 @@ int np2srv_sr_get_schema(sr_session_ctx_t *srs, const char *module_name, const c
 
 char *op_get_srval(struct ly_ctx *ctx, const sr_val_t *value, char *buf);
 
+/**
+ * @brief Module schema properties, precomputed whenever the libyang context changes.
+ */
+#define OP_MOD_DATA 0x01        /**< top-level data definitions */
+#define OP_MOD_CONFIG 0x02      /**< top-level configuration data nodes */
+#define OP_MOD_STATE 0x04       /**< top-level state data nodes */
+#define OP_MOD_NOTIF_TOP 0x08   /**< top-level notifications */
+#define OP_MOD_NOTIF 0x10       /**< notifications anywhere in the data tree */
+#define OP_MOD_RPC 0x20         /**< RPCs */
+
+struct op_mod_info {
+    const struct lys_module *module;
+    int flags;                  /**< OP_MOD_* flags */
+};
+
+/**
+ * @brief Rebuild the module index, MUST be called holding the libyang context lock for writing
+ * (or before the server starts).
+ */
+int op_mod_index_rebuild(void);
+
+/**
+ * @brief Free the module index.
+ */
+void op_mod_index_clear(void);
+
+/**
+ * @brief Get the module index, in the context module order.
+ */
+const struct op_mod_info *op_mod_index(uint32_t *count);
+
+/**
+ * @brief Get the OP_MOD_* flags of a module.
+ */
+int op_mod_index_flags(const struct lys_module *module);
+
+/**
+ * @brief Parameters of the RPCs handled by the server.
+ */
+enum op_param {
+    OP_PARAM_GET_FILTER = 0,
+    OP_PARAM_GET_WD,
+    OP_PARAM_GET_LIMIT,
+    OP_PARAM_GET_OFFSET,
+    OP_PARAM_GET_CURSOR,
+    OP_PARAM_GET_DEPTH,
+    OP_PARAM_GETCONFIG_SOURCE,
+    OP_PARAM_GETCONFIG_FILTER,
+    OP_PARAM_GETCONFIG_WD,
+    OP_PARAM_GETCONFIG_LIMIT,
+    OP_PARAM_GETCONFIG_OFFSET,
+    OP_PARAM_GETCONFIG_CURSOR,
+    OP_PARAM_GETCONFIG_DEPTH,
+    OP_PARAM_EDIT_TARGET,
+    OP_PARAM_EDIT_DEFOP,
+    OP_PARAM_EDIT_TESTOPT,
+    OP_PARAM_EDIT_ERROPT,
+    OP_PARAM_EDIT_CONFIG,
+    OP_PARAM_COPY_TARGET,
+    OP_PARAM_COPY_SOURCE,
+    OP_PARAM_DELETE_TARGET,
+    OP_PARAM_LOCK_TARGET,
+    OP_PARAM_UNLOCK_TARGET,
+    OP_PARAM_VALIDATE_SOURCE,
+    OP_PARAM_KILL_SESSIONID,
+    OP_PARAM_COMMIT_CONFIRMED,
+    OP_PARAM_COMMIT_TIMEOUT,
+    OP_PARAM_COMMIT_PERSIST,
+    OP_PARAM_COMMIT_PERSISTID,
+    OP_PARAM_CANCEL_PERSISTID,
+    OP_PARAM_COUNT
+};
+
+/**
+ * @brief Resolve the schema nodes of all the RPC parameters, MUST be called holding the libyang context
+ * lock for writing (or before the server starts).
+ */
+void op_params_resolve(void);
+
+/**
+ * @brief Get an RPC parameter by comparing the schema nodes of the RPC children.
+ *
+ * @param[in] rpc RPC data node.
+ * @param[in] param Parameter to get.
+ * @return Parameter node, NULL if not present.
+ */
+struct lyd_node *op_param_get(const struct lyd_node *rpc, enum op_param param);
+
+/**
+ * @brief Drop all the cached decimal64 fraction-digits, they are bound to the current libyang context
+ */
+void op_dec64_cache_clear(void);
+
+/**
+ * @brief Change the data in sysrepo from the current tree to the new one by applying only their differences.
+ *
+ * @param[in] srs Session to make the changes in.
+ * @param[in] xpath Path selecting all the data of both trees, used to remove them if there is no new tree.
+ * @param[in] current Current data (with siblings), NULL if there are none.
+ * @param[in] data New data (with siblings), NULL to remove all the current data.
+ * @param[out] changes Optional number of applied changes.
+ * @param[out] ereply Optional reply to add errors into.
+ * @return 0 on success, non-zero on error.
+ */
+int op_tree_replace(sr_session_ctx_t *srs, const char *xpath, struct lyd_node *current, struct lyd_node *data,
+                    uint32_t *changes, struct nc_server_reply **ereply);
+
+/**
+ * @brief Undo log of the changes made in a sysrepo session by a single RPC.
+ *
+ * Every changed node is saved right before its change, restoring replays the saved nodes
+ * in the reverse order, so the other changes of the session are kept.
+ */
+struct op_undo {
+    struct op_undo_entry {
+        char *xpath;                   /**< path of the changed node */
+        struct lyd_node *data;         /**< saved node with its ancestors, NULL if it did not exist */
+        struct lyd_node *node;         /**< the saved node in data */
+        char *prev;                    /**< preceding instance of a user-ordered node, NULL if it was the first */
+        int moved;                     /**< only the position of the node is changed */
+    } *entries;
+    uint32_t count;
+};
+
+/**
+ * @brief Save a node before it is changed.
+ *
+ * Only the configuration is saved and restored, the session should be config-only (op_sessions_config_only()).
+ *
+ * @param[in] undo Undo log to add into.
+ * @param[in] srs Session to read from.
+ * @param[in] xpath Path of the node.
+ * @param[in] subtree Whether the whole subtree is changed (removed or replaced), otherwise only
+ * a leaf value or the existence of an inner node.
+ * @return 0 on success, -1 on error.
+ */
+int op_undo_save(struct op_undo *undo, sr_session_ctx_t *srs, const char *xpath, int subtree);
+
+/**
+ * @brief Save the position of an instance of a user-ordered node before it is moved.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int op_undo_save_position(struct op_undo *undo, sr_session_ctx_t *srs, const char *xpath);
+
+/**
+ * @brief Revert all the saved changes in the session.
+ *
+ * @return 0 on success, non-zero on error, the changes are reverted only partially.
+ */
+int op_undo_restore(struct op_undo *undo, sr_session_ctx_t *srs);
+
+void op_undo_free(struct op_undo *undo);
+
+/**
+ * @brief Arena for the transient data of a single RPC, every thread has its own.
+ *
+ * The allocated memory is never freed separately, the whole arena is reset when the RPC
+ * is finished and its memory is kept (merged into a single block) for the next RPC.
+ */
+struct op_arena;
+
+struct op_arena_block;
+
+/**
+ * @brief Position in an arena, everything allocated after it can be released at once.
+ */
+struct op_arena_mark {
+    struct op_arena_block *block;
+    size_t used;
+};
+
+/**
+ * @brief Get the arena of the current thread.
+ */
+struct op_arena *op_arena_get(void);
+
+void *op_arena_alloc(struct op_arena *arena, size_t size);
+
+/**
+ * @brief Enlarge an arena allocation, in place if it was the last one, otherwise it is copied.
+ */
+void *op_arena_grow(struct op_arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+char *op_arena_printf(struct op_arena *arena, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+struct op_arena_mark op_arena_mark(struct op_arena *arena);
+
+/**
+ * @brief Release all the allocations made after the mark, nothing may be used anymore.
+ */
+void op_arena_release(struct op_arena *arena, struct op_arena_mark mark);
+
+/**
+ * @brief Release all the allocations, to be called when the RPC is finished.
+ */
+void op_arena_reset(struct op_arena *arena);
+
 /**
  * @brief Fill sr_val_t for communication with sysrepo
  *
@@ -128,28 +326,280 @@ char *op_get_srval(struct ly_ctx *ctx, const sr_val_t *value, char *buf);
  *                 some data to fill the \p val structure, the allocated memory is returned as pointer
  *                 to char and can be freed with free(). The parameter to store the pointer is required
  *                 only if the \p dup is zero.
+ * @param[in] arena Optional arena to allocate the \p val_buf from instead, it must not be freed then.
  */
-int op_set_srval(struct lyd_node *node, char *path, int dup, sr_val_t *val, char **val_buf);
+int op_set_srval(struct lyd_node *node, char *path, int dup, sr_val_t *val, char **val_buf, struct op_arena *arena);
 
 /**
  * @brief Build error reply because of NACM access denied
  */
 struct nc_server_reply *op_build_err_nacm(struct nc_server_reply *ereply);
 
-int op_filter_get_tree_from_data(struct lyd_node **root, struct lyd_node *data, const char *subtree_path);
+struct op_mem_budget;
+
+/**
+ * @brief Copy the subtrees selected by a filter from data into root
+ *
+ * @param[in,out] root Data tree to add the selected subtrees to, can point to NULL.
+ * @param[in] data Source data tree.
+ * @param[in] subtree_path Filter XPath.
+ * @param[in] depth Number of levels of the selected subtrees to copy, 0 for unlimited.
+ * @param[in] budget Budget charged with the copy, optional.
+ * @return 0 on success, -1 on error.
+ */
+int op_filter_get_tree_from_data(struct lyd_node **root, struct lyd_node *data, const char *subtree_path, uint16_t depth,
+                                 struct op_mem_budget *budget);
 int op_filter_xpath_add_filter(char *new_filter, char ***filters, int *filter_count);
 int op_filter_create(struct lyd_node *filter_node, char ***filters, int *filter_count);
-int op_sr_val_to_lyd_node(struct lyd_node *root, const sr_val_t *sr_val, struct lyd_node **new_node);
+
+/**
+ * @brief FNV-1a hash of a string.
+ */
+uint32_t op_str_hash(const char *str, size_t len);
+
+/**
+ * @brief Drop all the compiled filters, they are bound to the current libyang context
+ */
+void op_filter_cache_clear(void);
+
+/**
+ * @brief Get the filter cache size and hit/miss counters
+ */
+void op_filter_cache_stats(uint32_t *count, uint64_t *hits, uint64_t *misses);
+
+/**
+ * @brief Operations with accounted reply memory.
+ */
+enum op_mem_type {
+    OP_MEM_GET = 0,
+    OP_MEM_GETCONFIG,
+    OP_MEM_TYPE_COUNT
+};
+
+/**
+ * @brief Estimated memory used by the reply of a single RPC, limited by NP2SRV_RPC_MEM_LIMIT
+ * and, together with all the other RPCs, by NP2SRV_MEM_LIMIT.
+ */
+struct op_mem_budget {
+    uint64_t used;            /**< estimated size of the reply data */
+    uint64_t reserved;        /**< size reserved from the global budget */
+    NC_ERR exceeded;          /**< NC_ERR_TOO_BIG or NC_ERR_RES_DENIED after a failed charge */
+};
+
+/**
+ * @brief Charge size bytes to the budget.
+ *
+ * @return 0 on success, -1 if a limit was exceeded.
+ */
+int op_mem_charge(struct op_mem_budget *budget, uint64_t size);
+
+/**
+ * @brief Estimate the memory used by a data tree (with its siblings), as charged to a budget.
+ */
+uint64_t op_mem_tree_size(const struct lyd_node *tree);
+
+/**
+ * @brief Return the budget to the global budget and record the peak usage of the operation.
+ */
+void op_mem_release(struct op_mem_budget *budget, enum op_mem_type type);
+
+/**
+ * @brief Build the error reply of an exceeded budget.
+ */
+struct nc_server_reply *op_mem_budget_err(const struct op_mem_budget *budget);
+
+/**
+ * @brief Get the global budget usage and the peak usage of every operation.
+ */
+void op_mem_stats(uint64_t *used, uint64_t peak[OP_MEM_TYPE_COUNT]);
+
+/**
+ * @brief Builder of a data tree from sysrepo values in the document order (as returned by sysrepo).
+ *
+ * It remembers the last created inner node with all its ancestors so that the following
+ * descendants are created relative to them and full paths are resolved only on jumps.
+ */
+struct op_tree_builder {
+    struct lyd_node *root;    /**< built data tree, can be set before adding any values */
+    struct lyd_node **nodes;  /**< cursor, the last created inner node and its ancestors */
+    size_t *path_lens;        /**< lengths of the paths of the cursor nodes */
+    uint16_t depth;           /**< number of nodes in the cursor */
+    uint16_t size;            /**< allocated cursor size */
+    char *path;               /**< path of the deepest cursor node */
+    size_t path_size;         /**< allocated path size */
+    struct op_mem_budget *budget; /**< budget charged with the created nodes, optional */
+};
+
+/**
+ * @brief Add a sysrepo value into the built tree, with any of its missing ancestors.
+ *
+ * An existing node is kept as it is, the nodes created are charged to the builder budget.
+ *
+ * @return 0 on success, -1 on error (including an exceeded budget).
+ */
+int op_tree_builder_add(struct op_tree_builder *builder, const sr_val_t *sr_val);
+
+/**
+ * @brief Free the builder cursor, the built tree is not freed.
+ */
+void op_tree_builder_clean(struct op_tree_builder *builder);
+
+/**
+ * @brief Add sysrepo data selected by the xpath into the tree, nothing is added if there are no such data.
+ *
+ * State data are added as well unless the session is config-only, so the session of operations
+ * comparing or restoring the configuration must be switched by op_sessions_config_only() first.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int op_tree_builder_fetch(sr_session_ctx_t *srs, struct lyd_node **root, const char *xpath, struct op_mem_budget *budget);
+
+/**
+ * @brief Drop the iteration of a paged read kept for the next page.
+ */
+void op_get_paging_clear(struct np2_sessions *sessions);
+
+/**
+ * @brief Make the sysrepo session of the NETCONF session read only the configuration.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int op_sessions_config_only(struct np2_sessions *sessions, struct nc_server_reply **ereply);
+
+/**
+ * @brief Apply a libyang diff of two data trees into sysrepo, so that the data of the first tree
+ * become the second tree. Stops on the first failed change.
+ *
+ * @return 0 on success, non-zero if some change failed (ereply is filled).
+ */
+int op_diff_apply(sr_session_ctx_t *srs, struct lyd_difflist *diff, struct nc_server_reply **ereply);
 
 struct nc_server_reply *op_get(struct lyd_node *rpc, struct nc_session *ncs);
+
+/**
+ * @brief Drop all the cached running configuration (NP2SRV_CONFIG_CACHE_SIZE)
+ */
+void op_config_cache_clear(void);
+
+/**
+ * @brief Drop all the cached running configuration and forget the change subscriptions,
+ * they were removed with the sysrepo subscription context
+ */
+void op_config_cache_reset(void);
+
+/**
+ * @brief Statistics of a state cache subtree
+ */
+struct op_state_cache_stat {
+    char *xpath;
+    uint64_t hits;
+    uint64_t misses;
+    int64_t age;              /**< age of the most recent snapshot in ms, -1 if there is none */
+};
+
+/**
+ * @brief Set the subtrees cached for <get>, all the snapshots are dropped.
+ *
+ * @param[in] xpaths Absolute paths of the subtrees, spent.
+ * @param[in] ttls Maximum age of the snapshots of every subtree in ms.
+ * @param[in] count Number of subtrees.
+ * @return 0 on success, -1 on error.
+ */
+int op_state_cache_configure(char **xpaths, uint32_t *ttls, uint32_t count);
+
+/**
+ * @brief Drop all the state snapshots, they are bound to the current libyang context
+ * and may reflect the previous configuration.
+ */
+void op_state_cache_clear(void);
+
+/**
+ * @brief Get the statistics of all the cached subtrees, the xpaths and the array are to be freed.
+ */
+int op_state_cache_stats(struct op_state_cache_stat **stats, uint32_t *count);
+
+/**
+ * @brief Do not share the reads in progress with the following reads, they may have started before a commit.
+ */
+void op_get_shared_invalidate(void);
+
+/**
+ * @brief Get the number of reads answered with the data of an identical concurrent read
+ */
+void op_get_shared_stats(uint64_t *hits);
+
+/**
+ * @brief Set the maximum delay of <edit-config> of running waiting for a group commit, 0 disables it.
+ */
+void op_editconfig_group_configure(uint32_t delay);
+
 struct nc_server_reply *op_lock(struct lyd_node *rpc, struct nc_session *ncs);
 struct nc_server_reply *op_unlock(struct lyd_node *rpc, struct nc_session *ncs);
 struct nc_server_reply *op_editconfig(struct lyd_node *rpc, struct nc_session *ncs);
 struct nc_server_reply *op_copyconfig(struct lyd_node *rpc, struct nc_session *ncs);
+
+/**
+ * @brief Set whether copying running into startup copies only the modules changed since the last such copy.
+ */
+void op_copyconfig_incremental_configure(int enable);
+
+/**
+ * @brief Remember a module changed in running or startup, it must be copied into startup next time.
+ *
+ * @param[in] module_name Changed module, NULL if all the modules can be changed.
+ */
+void op_startup_mark(const char *module_name);
+
+/**
+ * @brief Forget the tracked changes and the change subscriptions, they were removed with the sysrepo
+ * subscription context
+ */
+void op_startup_reset(void);
 struct nc_server_reply *op_deleteconfig(struct lyd_node *rpc, struct nc_session *ncs);
 struct nc_server_reply *op_commit(struct lyd_node *rpc, struct nc_session *ncs);
+
+/**
+ * @brief Remember a module changed in the candidate of the session, the candidate is marked as changed.
+ *
+ * @param[in] sessions Session with the candidate.
+ * @param[in] module_name Changed module, NULL if all the modules can be changed.
+ */
+void op_cand_mark(struct np2_sessions *sessions, const char *module_name);
+
+/**
+ * @brief Forget all the changes of the candidate, it is the same as running.
+ */
+void op_cand_clear(struct np2_sessions *sessions);
+
+struct nc_server_reply *op_cancelcommit(struct lyd_node *rpc, struct nc_session *ncs);
+
+/**
+ * @brief Check whether a confirmed commit of another session is pending, running cannot be locked then.
+ */
+int op_confirmed_other(struct nc_session *ncs);
+
+/**
+ * @brief Roll back the pending confirmed commit (asynchronously) if it was issued by the session without persist.
+ */
+void op_confirmed_session_end(struct nc_session *ncs);
+
+/**
+ * @brief Roll back the pending confirmed commit, if any, and wait for its timer. To be called
+ * when the server stops, before the sessions are freed.
+ */
+void op_confirmed_stop(void);
 struct nc_server_reply *op_discardchanges(struct lyd_node *rpc, struct nc_session *ncs);
 struct nc_server_reply *op_validate(struct lyd_node *rpc, struct nc_session *ncs);
+
+/**
+ * @brief Drop all the cached <validate> results, they are bound to the current libyang context
+ */
+void op_validate_cache_clear(void);
+
+/**
+ * @brief Get the number of cached valid <config> contents and the hit/miss counters
+ */
+void op_validate_cache_stats(uint32_t *count, uint64_t *hits, uint64_t *misses);
 struct nc_server_reply *op_generic(struct lyd_node *rpc, struct nc_session *ncs);
 struct nc_server_reply *op_kill(struct lyd_node *rpc, struct nc_session *ncs);
 
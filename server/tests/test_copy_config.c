@@ -42,6 +42,8 @@
 
 volatile int initialized;
 int pipes[2][2], p_in, p_out;
+struct lyd_node *running;
+int set_count, delete_count;
 
 /*
  * SYSREPO WRAPPER FUNCTIONS
@@ -189,6 +191,59 @@ __wrap_sr_session_switch_ds(sr_session_ctx_t *session, sr_datastore_t ds)
     return SR_ERR_OK;
 }
 
+int
+__wrap_sr_session_set_options(sr_session_ctx_t *session, const sr_sess_options_t opts)
+{
+    (void)session;
+    assert_true(opts & SR_SESS_CONFIG_ONLY);
+    return SR_ERR_OK;
+}
+
+int
+__wrap_sr_get_items_iter(sr_session_ctx_t *session, const char *xpath, sr_val_iter_t **iter)
+{
+    (void)session;
+
+    if (!running) {
+        return SR_ERR_NOT_FOUND;
+    }
+    *iter = (sr_val_iter_t *)strdup(xpath);
+
+    return SR_ERR_OK;
+}
+
+int
+__wrap_sr_get_item_next(sr_session_ctx_t *session, sr_val_iter_t *iter, sr_val_t **value)
+{
+    static struct ly_set *set = NULL;
+    static unsigned int idx;
+    const char *xpath = (const char *)iter;
+    char *path;
+    (void)session;
+
+    if (!set) {
+        assert_string_equal(xpath, "/ietf-interfaces:*//.");
+        set = lyd_find_path(running, xpath);
+        idx = 0;
+    }
+
+    if (idx == set->number) {
+        ly_set_free(set);
+        set = NULL;
+        *value = NULL;
+        return SR_ERR_NOT_FOUND;
+    }
+
+    path = lyd_path(set->set.d[idx]);
+    *value = calloc(1, sizeof **value);
+    op_set_srval(set->set.d[idx], path, 1, *value, NULL, NULL);
+    (*value)->dflt = set->set.d[idx]->dflt;
+    free(path);
+    ++idx;
+
+    return SR_ERR_OK;
+}
+
 void
 __wrap_sr_free_val_iter(sr_val_iter_t *iter)
 {
@@ -203,9 +258,8 @@ __wrap_sr_set_item(sr_session_ctx_t *session, const char *xpath, const sr_val_t
     (void)session;
     (void)value;
     (void)opts;
-    static int count = 0;
 
-    switch (count) {
+    switch (set_count) {
     case 0:
         assert_string_equal(xpath, "/ietf-interfaces:interfaces/interface[name='iface1']");
         break;
@@ -249,22 +303,14 @@ __wrap_sr_set_item(sr_session_ctx_t *session, const char *xpath, const sr_val_t
         assert_string_equal(xpath, "/ietf-interfaces:interfaces/interface[name='iface1']/ietf-ip:ipv6/forwarding");
         break;
     case 14:
-        assert_string_equal(xpath, "/ietf-interfaces:interfaces/interface[name='iface1']/ietf-ip:ipv6/dup-addr-detect-transmits");
-        break;
-    case 15:
-        assert_string_equal(xpath, "/ietf-interfaces:interfaces/interface[name='iface1']/ietf-ip:ipv6/autoconf/create-global-addresses");
-        break;
-    case 16:
-        assert_string_equal(xpath, "/ietf-interfaces:interfaces/interface[name='iface1']/ietf-ip:ipv6/autoconf/create-temporary-addresses");
-        break;
-    case 17:
-        assert_string_equal(xpath, "/ietf-interfaces:interfaces/interface[name='iface1']/ietf-ip:ipv6/autoconf/temporary-valid-lifetime");
-        break;
-    case 18:
-        assert_string_equal(xpath, "/ietf-interfaces:interfaces/interface[name='iface1']/ietf-ip:ipv6/autoconf/temporary-preferred-lifetime");
+        /* only the differences from the current data */
+        assert_string_equal(xpath, "/ietf-interfaces:interfaces/interface[name='iface1']/description");
+        assert_string_equal(value->data.string_val, "new dsc");
         break;
+    default:
+        fail();
     }
-    ++count;
+    ++set_count;
 
     return SR_ERR_OK;
 }
@@ -280,9 +326,17 @@ int
 __wrap_sr_delete_item(sr_session_ctx_t *session, const char *xpath, const sr_edit_options_t opts)
 {
     (void)session;
-    (void)xpath;
     (void)opts;
 
+    switch (delete_count) {
+    case 0:
+        assert_string_equal(xpath, "/ietf-interfaces:interfaces/interface[name='iface1']/ietf-ip:ipv4/mtu");
+        break;
+    default:
+        fail();
+    }
+    ++delete_count;
+
     return SR_ERR_OK;
 }
 
@@ -558,6 +612,89 @@ test_edit_config(void **state)
 
     test_write(p_out, copy_rpc, __LINE__);
     test_read(p_in, copy_rpl, __LINE__);
+
+    /* running was empty, default nodes are not created */
+    assert_int_equal(set_count, 14);
+    assert_int_equal(delete_count, 0);
+}
+
+static void
+test_copy_config_diff(void **state)
+{
+    (void)state; /* unused */
+    const char *running_data =
+"<interfaces xmlns=\"urn:ietf:params:xml:ns:yang:ietf-interfaces\">"
+  "<interface>"
+    "<name>iface1</name>"
+    "<description>iface1 dsc</description>"
+    "<type xmlns:ianaift=\"urn:ietf:params:xml:ns:yang:iana-if-type\">ianaift:ethernetCsmacd</type>"
+    "<enabled>true</enabled>"
+    "<link-up-down-trap-enable>disabled</link-up-down-trap-enable>"
+    "<ipv4 xmlns=\"urn:ietf:params:xml:ns:yang:ietf-ip\">"
+      "<enabled>true</enabled>"
+      "<forwarding>true</forwarding>"
+      "<mtu>68</mtu>"
+      "<neighbor>"
+        "<ip>10.0.0.2</ip>"
+        "<link-layer-address>01:34:56:78:9a:bc:de:f0</link-layer-address>"
+      "</neighbor>"
+    "</ipv4>"
+    "<ipv6 xmlns=\"urn:ietf:params:xml:ns:yang:ietf-ip\">"
+      "<enabled>true</enabled>"
+      "<forwarding>false</forwarding>"
+    "</ipv6>"
+  "</interface>"
+"</interfaces>";
+    const char *copy_rpc =
+    "<rpc msgid=\"2\" xmlns=\"urn:ietf:params:xml:ns:netconf:base:1.0\">"
+        "<copy-config>"
+            "<target>"
+                "<running/>"
+            "</target>"
+            "<source>"
+                "<config>"
+"<interfaces xmlns=\"urn:ietf:params:xml:ns:yang:ietf-interfaces\">"
+  "<interface>"
+    "<name>iface1</name>"
+    "<description>new dsc</description>"
+    "<type xmlns:ianaift=\"urn:ietf:params:xml:ns:yang:iana-if-type\">ianaift:ethernetCsmacd</type>"
+    "<enabled>true</enabled>"
+    "<link-up-down-trap-enable>disabled</link-up-down-trap-enable>"
+    "<ipv4 xmlns=\"urn:ietf:params:xml:ns:yang:ietf-ip\">"
+      "<enabled>true</enabled>"
+      "<forwarding>true</forwarding>"
+      "<neighbor>"
+        "<ip>10.0.0.2</ip>"
+        "<link-layer-address>01:34:56:78:9a:bc:de:f0</link-layer-address>"
+      "</neighbor>"
+    "</ipv4>"
+    "<ipv6 xmlns=\"urn:ietf:params:xml:ns:yang:ietf-ip\">"
+      "<enabled>true</enabled>"
+      "<forwarding>false</forwarding>"
+    "</ipv6>"
+  "</interface>"
+"</interfaces>"
+                "</config>"
+            "</source>"
+        "</copy-config>"
+    "</rpc>";
+    const char *copy_rpl =
+    "<rpc-reply msgid=\"2\" xmlns=\"urn:ietf:params:xml:ns:netconf:base:1.0\">"
+        "<ok/>"
+    "</rpc-reply>";
+
+    running = lyd_parse_mem(np2srv.ly_ctx, running_data, LYD_XML, LYD_OPT_CONFIG);
+    assert_non_null(running);
+
+    test_write(p_out, copy_rpc, __LINE__);
+    test_read(p_in, copy_rpl, __LINE__);
+
+    /* only the changed description and the removed mtu */
+    assert_int_equal(set_count, 15);
+    assert_int_equal(delete_count, 1);
+
+    lyd_free_withsiblings(running);
+    running = NULL;
 }
 
 static void
@@ -574,6 +711,7 @@ main(void)
     const struct CMUnitTest tests[] = {
                     cmocka_unit_test_setup(test_startstop, np_start),
                     cmocka_unit_test(test_edit_config),
+                    cmocka_unit_test(test_copy_config_diff),
                     cmocka_unit_test_teardown(test_startstop, np_stop),
     };
 
@@ -454,6 +454,7 @@ test_get(void **state)
                 "<namespace>urn:ietf:params:xml:ns:netconf:base:1.0</namespace>"
                 "<feature>writable-running</feature>"
                 "<feature>candidate</feature>"
+                "<feature>confirmed-commit</feature>"
                 "<feature>rollback-on-error</feature>"
                 "<feature>validate</feature>"
                 "<feature>startup</feature>"
@@ -556,6 +557,7 @@ test_get(void **state)
                     "<namespace>urn:ietf:params:xml:ns:netconf:base:1.0</namespace>"
                     "<feature>writable-running</feature>"
                     "<feature>candidate</feature>"
+                    "<feature>confirmed-commit</feature>"
                     "<feature>rollback-on-error</feature>"
                     "<feature>validate</feature>"
                     "<feature>startup</feature>"
@@ -600,6 +602,7 @@ test_get(void **state)
                     "<capability>urn:ietf:params:netconf:base:1.1</capability>"
                     "<capability>urn:ietf:params:netconf:capability:writable-running:1.0</capability>"
                     "<capability>urn:ietf:params:netconf:capability:candidate:1.0</capability>"
+                    "<capability>urn:ietf:params:netconf:capability:confirmed-commit:1.1</capability>"
                     "<capability>urn:ietf:params:netconf:capability:rollback-on-error:1.0</capability>"
                     "<capability>urn:ietf:params:netconf:capability:validate:1.1</capability>"
                     "<capability>urn:ietf:params:netconf:capability:startup:1.0</capability>"
@@ -615,7 +618,7 @@ test_get(void **state)
                     "<capability>urn:ietf:params:xml:ns:yang:ietf-yang-library?module=ietf-yang-library&amp;revision=2017-08-17&amp;module-set-id=15</capability>"
                     "<capability>ns?module=ietf-netconf-server</capability>"
                     "<capability>urn:ietf:params:xml:ns:yang:ietf-netconf-acm?module=ietf-netconf-acm&amp;revision=2012-02-22</capability>"
-                    "<capability>urn:ietf:params:xml:ns:netconf:base:1.0?module=ietf-netconf&amp;revision=2011-06-01&amp;features=writable-running,candidate,rollback-on-error,validate,startup,xpath</capability>"
+                    "<capability>urn:ietf:params:xml:ns:netconf:base:1.0?module=ietf-netconf&amp;revision=2011-06-01&amp;features=writable-running,candidate,confirmed-commit,rollback-on-error,validate,startup,xpath</capability>"
                     "<capability>urn:ietf:params:xml:ns:yang:ietf-netconf-monitoring?module=ietf-netconf-monitoring&amp;revision=2010-10-04</capability>"
                     "<capability>urn:ietf:params:xml:ns:yang:ietf-netconf-with-defaults?module=ietf-netconf-with-defaults&amp;revision=2011-06-01</capability>"
                     "<capability>urn:ietf:params:xml:ns:netconf:notification:1.0?module=notifications&amp;revision=2008-07-14</capability>"
@@ -934,6 +937,7 @@ test_get_filter2(void **state)
                     "<namespace>urn:ietf:params:xml:ns:netconf:base:1.0</namespace>"
                     "<feature>writable-running</feature>"
                     "<feature>candidate</feature>"
+                    "<feature>confirmed-commit</feature>"
                     "<feature>rollback-on-error</feature>"
                     "<feature>validate</feature>"
                     "<feature>startup</feature>"
@@ -1110,6 +1114,7 @@ test_get_filter4(void **state)
                     "<revision>2011-06-01</revision>"
                     "<feature>writable-running</feature>"
                     "<feature>candidate</feature>"
+                    "<feature>confirmed-commit</feature>"
                     "<feature>rollback-on-error</feature>"
                     "<feature>validate</feature>"
                     "<feature>startup</feature>"